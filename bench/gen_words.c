@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+/*
+ * Deterministic generator of password like lists, for the benchmarks: a same
+ * seed and same options always give the same list, on every platform.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WORD_MAX 64
+
+static const char *bases[] = {
+    "password", "dragon", "monkey", "shadow", "master", "sunshine", "princess", "football", "baseball", "welcome",
+    "letmein", "trustno", "superman", "batman", "michael", "jessica", "charlie", "summer", "winter", "autumn",
+    "spring", "flower", "hunter", "ranger", "soccer", "hockey", "killer", "secret", "freedom", "whatever",
+    "qwerty", "azerty", "abc", "iloveyou", "lovely", "angel", "tigger", "purple", "orange", "yellow",
+    "silver", "golden", "diamond", "pepper", "ginger", "cookie", "cheese", "banana", "chocolate", "butterfly",
+    "starwars", "pokemon", "matrix", "mustang", "ferrari", "corvette", "harley", "thunder", "lightning", "phoenix",
+    "jordan", "thomas", "robert", "daniel", "andrew", "joshua", "matthew", "nicole", "ashley", "amanda",
+    "london", "paris", "berlin", "madrid", "chicago", "dallas", "boston", "toronto", "sydney", "tokyo",
+    "admin", "root", "guest", "login", "access", "system", "server", "network", "computer", "internet",
+    "money", "family", "friend", "forever", "heaven", "jesus", "blessed", "rainbow", "snoopy", "garfield",
+};
+
+#define NB_BASES (sizeof(bases) / sizeof(bases[0]))
+
+static const char leet_from[] = "aeiost";
+static const char leet_to[] = "4310$7";
+static const char symbols[] = "!@#$%&*?.";
+
+struct options_t {
+    size_t count;
+    uint64_t seed;
+    /* Probabilities, in percent. */
+    unsigned int duplicates, leet, capital, suffix, compound, symbol;
+    size_t min_len, max_len;
+};
+typedef struct options_t options_t;
+
+/* splitmix64: a 64 bits state, fully determined by the seed. */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+static size_t random_below(uint64_t *state, size_t n)
+{
+    return (size_t) (next_random(state) % n);
+}
+
+static int percent(uint64_t *state, unsigned int p)
+{
+    return random_below(state, 100) < p;
+}
+
+static size_t append(char *word, size_t len, const char *s)
+{
+    size_t n = strlen(s);
+
+    if (len + n > WORD_MAX)
+        n = WORD_MAX - len;
+    memcpy(word + len, s, n);
+
+    return len + n;
+}
+
+/* A new word in word (not NUL terminated), returns its length. */
+static size_t make_word(uint64_t *state, const options_t *opts, char *word)
+{
+    size_t len, i, nb_digits, max_len;
+    const char *p;
+    char digits[8];
+
+    len = append(word, 0, bases[random_below(state, NB_BASES)]);
+    if (percent(state, opts->compound))
+        len = append(word, len, bases[random_below(state, NB_BASES)]);
+    if (percent(state, opts->capital))
+        word[0] = (char) (word[0] - 'a' + 'A');
+    for (i = 0; i < len; i++) {
+        if ((NULL != (p = strchr(leet_from, word[i]))) && percent(state, opts->leet))
+            word[i] = leet_to[p - leet_from];
+    }
+    if (percent(state, opts->suffix)) {
+        /* Mostly 1 or 2 digits, sometimes a year. */
+        if (0 == random_below(state, 4))
+            snprintf(digits, sizeof(digits), "%zu", 1950 + random_below(state, 75));
+        else {
+            for (nb_digits = 1 + random_below(state, 2) + random_below(state, 2), i = 0; i < nb_digits; i++)
+                digits[i] = (char) ('0' + random_below(state, 10));
+            digits[i] = '\0';
+        }
+        len = append(word, len, digits);
+    }
+    if ((len < WORD_MAX) && percent(state, opts->symbol))
+        word[len++] = symbols[random_below(state, sizeof(symbols) - 1)];
+
+    /* Length distribution: a uniform target between min and max. */
+    max_len = opts->min_len + random_below(state, opts->max_len - opts->min_len + 1);
+    if (len > max_len)
+        len = max_len;
+    while (len < opts->min_len)
+        word[len++] = (char) ('0' + random_below(state, 10));
+
+    return len;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n count] [-s seed] [-d dup%%] [-l leet%%] [-c capital%%] [-x suffix%%] [-w compound%%]\n", name);
+    fprintf(stderr, "       [-y symbol%%] [-m min_len] [-M max_len]\n");
+    fprintf(stderr, "  writes count password like words to stdout, the same ones for a same seed\n");
+}
+
+static int parse_percent(const char *arg, unsigned int *value)
+{
+    char *end;
+    unsigned long v = strtoul(arg, &end, 10);
+
+    if (('\0' == *arg) || ('\0' != *end) || (v > 100))
+        return -1;
+    *value = (unsigned int) v;
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    options_t opts = { 1000, 1, 10, 30, 30, 60, 20, 10, 5, 20 };
+    uint64_t state;
+    char word[WORD_MAX + 1], **emitted;
+    size_t i, len, *emitted_lens;
+    int opt, rv;
+
+    while (-1 != (opt = getopt(argc, argv, "n:s:d:l:c:x:w:y:m:M:"))) {
+        rv = 0;
+        switch (opt) {
+            case 'n':
+                opts.count = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                opts.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                rv = parse_percent(optarg, &opts.duplicates);
+                break;
+            case 'l':
+                rv = parse_percent(optarg, &opts.leet);
+                break;
+            case 'c':
+                rv = parse_percent(optarg, &opts.capital);
+                break;
+            case 'x':
+                rv = parse_percent(optarg, &opts.suffix);
+                break;
+            case 'w':
+                rv = parse_percent(optarg, &opts.compound);
+                break;
+            case 'y':
+                rv = parse_percent(optarg, &opts.symbol);
+                break;
+            case 'm':
+                opts.min_len = strtoul(optarg, NULL, 10);
+                break;
+            case 'M':
+                opts.max_len = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+        if (0 != rv) {
+            fprintf(stderr, "invalid percentage %s\n", optarg);
+            return -1;
+        }
+    }
+    if ((0 == opts.min_len) || (opts.min_len > opts.max_len) || (opts.max_len > WORD_MAX)) {
+        fprintf(stderr, "lengths must verify 0 < min_len <= max_len <= %d\n", WORD_MAX);
+        return -1;
+    }
+
+    emitted = malloc((opts.count + 1) * sizeof(char *));
+    emitted_lens = malloc((opts.count + 1) * sizeof(size_t));
+    if ((NULL == emitted) || (NULL == emitted_lens)) {
+        perror("malloc");
+        return -1;
+    }
+    state = opts.seed;
+    for (i = 0; i < opts.count; i++) {
+        if ((i > 0) && percent(&state, opts.duplicates)) {
+            /* Repeat an earlier word, half of the time with another case. */
+            len = random_below(&state, i);
+            emitted[i] = emitted[len];
+            emitted_lens[i] = emitted_lens[len];
+            memcpy(word, emitted[i], emitted_lens[i]);
+            len = emitted_lens[i];
+            if ((0 == random_below(&state, 2)) && (word[0] >= 'a') && (word[0] <= 'z'))
+                word[0] = (char) (word[0] - 'a' + 'A');
+        }
+        else {
+            len = make_word(&state, &opts, word);
+            if (NULL == (emitted[i] = malloc(len))) {
+                perror("malloc");
+                return -1;
+            }
+            memcpy(emitted[i], word, len);
+            emitted_lens[i] = len;
+        }
+        word[len] = '\n';
+        fwrite(word, 1, len + 1, stdout);
+    }
+    fflush(stdout);
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+#
+# Copyright (C) 2014  François Pesce
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Usage: bench/run.sh "sizes" "cluster_words flags" [seed]
+#
+# Runs cluster_words on a generated list of each size and prints one JSON
+# object per size on stdout (JSON lines): the wall time of each pass, the
+# pairs scored per second in the third pass (neither pruned by length nor
+# filtered by an index) and the peak RSS.
+
+set -e
+
+SIZES=${1:-"1000 5000 20000 50000"}
+FLAGS=${2:-"-t 0.7"}
+SEED=${3:-1}
+DIR=$(dirname "$0")
+TMP=${TMPDIR:-/tmp}/cluster_words_bench.$$
+
+mkdir -p "$TMP"
+trap 'rm -rf "$TMP"' EXIT
+
+for n in $SIZES; do
+    "$DIR/gen_words" -n "$n" -s "$SEED" > "$TMP/words"
+    "$DIR/../cluster_words" $FLAGS "$TMP/words" > /dev/null 2> "$TMP/log"
+    awk -v n="$n" -v seed="$SEED" -v flags="$FLAGS" '
+        / pass: / { t[$1] = $3 }
+        / words, .* distinct$/ { distinct = $3 }
+        / pairs, / { pairs = $1; scored = $1 - $3 - $7 }
+        /^peak RSS: / { rss = $3 }
+        END {
+            total = t["first"] + t["second"] + t["third"] + t["fourth"]
+            printf("{\"words\": %d, \"distinct\": %d, \"seed\": %d, \"flags\": \"%s\", ", n, distinct, seed, flags)
+            printf("\"first_s\": %.3f, \"second_s\": %.3f, \"third_s\": %.3f, \"fourth_s\": %.3f, \"total_s\": %.3f, ",
+                   t["first"], t["second"], t["third"], t["fourth"], total)
+            printf("\"pairs\": %d, \"scored\": %d, \"pairs_per_s\": %.0f, \"peak_rss_kb\": %d}\n",
+                   pairs, scored, (t["third"] > 0) ? scored / t["third"] : 0, rss)
+        }' "$TMP/log"
+done
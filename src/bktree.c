@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bktree.h"
+#include "levenshtein.h"
+
+#define BKTREE_NONE SIZE_MAX
+
+/*
+ * Node n holds word n. The children of a node are chained through
+ * next_sibling, each at its own distance from the parent (the words at the
+ * same distance go down the same subtree).
+ */
+struct bktree_node_t {
+    size_t distance;
+    size_t first_child, next_sibling;
+};
+
+struct bktree_t {
+    const char * const *words;
+    const size_t *lens;
+    size_t nb_words;
+    struct bktree_node_t *pool;
+};
+
+struct bktree_search_t {
+    size_t *stack;
+};
+
+bktree_t *bktree_make(const char * const *words, const size_t *lens, size_t nb_words)
+{
+    bktree_t *tree;
+    struct bktree_node_t *node;
+    size_t w, n, child, d;
+
+    if (NULL == (tree = malloc(sizeof(bktree_t))))
+        return NULL;
+    tree->words = words;
+    tree->lens = lens;
+    tree->nb_words = nb_words;
+    if (NULL == (tree->pool = malloc((nb_words + 1) * sizeof(struct bktree_node_t)))) {
+        free(tree);
+        return NULL;
+    }
+
+    for (w = 0; w < nb_words; w++) {
+        node = tree->pool + w;
+        node->first_child = node->next_sibling = BKTREE_NONE;
+        node->distance = 0;
+        for (n = 0; (0 != w) && (BKTREE_NONE != n);) {
+            d = levenshtein_distance(words[n], lens[n], words[w], lens[w]);
+            for (child = tree->pool[n].first_child; (BKTREE_NONE != child) && (tree->pool[child].distance != d);
+                 child = tree->pool[child].next_sibling);
+            if (BKTREE_NONE == child) {
+                node->distance = d;
+                node->next_sibling = tree->pool[n].first_child;
+                tree->pool[n].first_child = w;
+            }
+            n = child;
+        }
+    }
+
+    return tree;
+}
+
+void bktree_destroy(bktree_t *tree)
+{
+    if (NULL != tree) {
+        free(tree->pool);
+        free(tree);
+    }
+}
+
+bktree_search_t *bktree_search_make(const bktree_t *tree)
+{
+    bktree_search_t *search;
+
+    if (NULL == (search = malloc(sizeof(bktree_search_t))))
+        return NULL;
+    if (NULL == (search->stack = malloc((tree->nb_words + 1) * sizeof(size_t)))) {
+        free(search);
+        return NULL;
+    }
+
+    return search;
+}
+
+void bktree_search_destroy(bktree_search_t *search)
+{
+    if (NULL != search) {
+        free(search->stack);
+        free(search);
+    }
+}
+
+size_t bktree_within(const bktree_t *tree, bktree_search_t *search, const char *word, size_t len, size_t max_edits, size_t *results)
+{
+    size_t nb_stack, nb_results, n, d, child;
+
+    if (0 == tree->nb_words)
+        return 0;
+    /* Each node is pushed at most once, by its parent. */
+    for (nb_results = 0, nb_stack = 0, search->stack[nb_stack++] = 0; nb_stack > 0;) {
+        n = search->stack[--nb_stack];
+        d = levenshtein_distance(tree->words[n], tree->lens[n], word, len);
+        if (d <= max_edits)
+            results[nb_results++] = n;
+        /* Triangle inequality: only children at |distance - d| <= max_edits. */
+        for (child = tree->pool[n].first_child; BKTREE_NONE != child; child = tree->pool[child].next_sibling) {
+            if ((tree->pool[child].distance + max_edits >= d) && (tree->pool[child].distance <= d + max_edits))
+                search->stack[nb_stack++] = child;
+        }
+    }
+
+    return nb_results;
+}
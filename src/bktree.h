@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef BKTREE_H
+#define BKTREE_H
+
+typedef struct bktree_t bktree_t;
+typedef struct bktree_search_t bktree_search_t;
+
+/**
+ * Make a Burkhard-Keller tree of a set of words under the (case folded)
+ * Levenshtein distance, used to find the words within a number of edits of
+ * a given one: the triangle inequality rules out every subtree whose edge
+ * distance is too far from the distance to its parent. Nodes come from a
+ * single pool, one per word.
+ * @param words The words, this array must outlive the tree.
+ * @param lens The length of each word, this array must outlive the tree.
+ * @param nb_words The number of words.
+ * @return Return a pointer to a newly allocated tree, NULL if an error
+ * occured.
+ */
+bktree_t *bktree_make(const char * const *words, const size_t *lens, size_t nb_words);
+
+/**
+ * Deallocate the tree.
+ * @param tree The tree you are working with.
+ */
+void bktree_destroy(bktree_t *tree);
+
+/**
+ * Make the work area of bktree_within, each thread searching the tree needs
+ * its own.
+ * @param tree The tree you are working with.
+ * @return Return a pointer to a newly allocated work area, NULL if an error
+ * occured.
+ */
+bktree_search_t *bktree_search_make(const bktree_t *tree);
+
+/**
+ * Deallocate a work area.
+ * @param search The work area you are working with.
+ */
+void bktree_search_destroy(bktree_search_t *search);
+
+/**
+ * Get the words within a number of edits of a word.
+ * @param tree The tree you are working with.
+ * @param search The work area of the calling thread.
+ * @param word The word, it does not need to be in the tree.
+ * @param len The length of the word.
+ * @param max_edits The largest distance of the words to get.
+ * @param results Receives the indexes of the words, in no particular order,
+ * it must have room for every word of the tree.
+ * @return The number of words found.
+ */
+size_t bktree_within(const bktree_t *tree, bktree_search_t *search, const char *word, size_t len, size_t max_edits, size_t *results);
+
+#endif /* BKTREE_H */
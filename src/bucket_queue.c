@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bucket_queue.h"
+#include "heap.h"
+#include "pool.h"
+
+/*
+ * Similarities are (zsize - distance) / zsize, and zsize is at most the sum
+ * of the lengths of the two words: the values reachable by short words are a
+ * small set of fractions, enumerated (Farey sequence) and sorted when the
+ * queue is made. Below max_denominator two different fractions are much
+ * further apart than a float rounding, so each float value of the set is one
+ * exact fraction and gets one bucket, found from the float bits through a
+ * small hash table. A bucket is an array of compact index pairs consumed in
+ * FIFO order, and buckets are scanned downward from the highest non empty
+ * one, which only ever moves up on insertion.
+ * Other values (very long words) go in an overflow binary heap; on extraction
+ * the best of the top bucket and of the heap root wins. Overflow pairs come
+ * from a pool, released with the queue.
+ */
+#define BUCKET_INITIAL_MAX 16
+#define BUCKET_OVERFLOW_SLAB 4096
+#define BUCKET_HASH(bits, slot_bits) ((size_t) (((uint32_t) ((bits) * UINT32_C(0x9E3779B1))) >> (32 - (slot_bits))))
+
+struct bucket_pair_t {
+    uint32_t word_1, word_2;
+};
+
+struct bucket_t {
+    struct bucket_pair_t *pairs;
+    size_t head, count, max;
+};
+
+struct bucket_overflow_t {
+    float value;
+    uint32_t word_1, word_2;
+};
+
+struct bucket_queue_t {
+    /* Value of each bucket, in increasing order. */
+    float *values;
+    struct bucket_t *buckets;
+    /* Float bits to bucket + 1, 0 for an empty slot. */
+    uint32_t *slots;
+    size_t nb_buckets, slot_bits;
+    /* Buckets from top on are empty. */
+    size_t top;
+    size_t count;
+    heap_t *overflow;
+    pool_t *overflow_pool;
+};
+
+static inline uint32_t bucket_float_bits(float value)
+{
+    union {
+        float f;
+        uint32_t u;
+    } bits;
+
+    bits.f = value;
+
+    return bits.u;
+}
+
+static int bucket_float_cmp(const void *data1, const void *data2)
+{
+    float f1 = *(const float *) data1;
+    float f2 = *(const float *) data2;
+
+    return (f1 < f2) ? -1 : ((f1 > f2) ? 1 : 0);
+}
+
+/* Most similar first, then smallest pair first. */
+static inline int bucket_pair_cmp(float value1, uint32_t word_1_1, uint32_t word_2_1, float value2, uint32_t word_1_2, uint32_t word_2_2)
+{
+    if (value1 != value2)
+        return (value1 > value2) ? 1 : -1;
+    if (word_1_1 != word_1_2)
+        return (word_1_1 < word_1_2) ? 1 : -1;
+
+    return (word_2_1 < word_2_2) ? 1 : ((word_2_1 > word_2_2) ? -1 : 0);
+}
+
+static int bucket_overflow_cmp(const void *data1, const void *data2)
+{
+    const struct bucket_overflow_t *o1 = data1;
+    const struct bucket_overflow_t *o2 = data2;
+
+    return bucket_pair_cmp(o1->value, o1->word_1, o1->word_2, o2->value, o2->word_1, o2->word_2);
+}
+
+/* Bucket holding value, or nb_buckets if there is none. */
+static inline size_t bucket_lookup(const bucket_queue_t *queue, float value)
+{
+    uint32_t bits = bucket_float_bits(value);
+    size_t mask = (((size_t) 1) << queue->slot_bits) - 1;
+    size_t slot;
+
+    for (slot = BUCKET_HASH(bits, queue->slot_bits); 0 != queue->slots[slot]; slot = (slot + 1) & mask) {
+        if (bucket_float_bits(queue->values[queue->slots[slot] - 1]) == bits)
+            return queue->slots[slot] - 1;
+    }
+
+    return queue->nb_buckets;
+}
+
+bucket_queue_t *bucket_queue_make(size_t max_denominator)
+{
+    bucket_queue_t *queue;
+    size_t m, z, i, nb_values, slot, mask;
+
+    if (NULL == (queue = calloc(1, sizeof(bucket_queue_t))))
+        return NULL;
+
+    /* Every m / z, 0 <= m <= z <= max_denominator, then duplicates removed. */
+    queue->values = malloc((max_denominator + 1) * (max_denominator + 2) / 2 * sizeof(float));
+    queue->overflow = heap_make(bucket_overflow_cmp, NULL);
+    queue->overflow_pool = pool_make(sizeof(struct bucket_overflow_t), BUCKET_OVERFLOW_SLAB);
+    if ((NULL == queue->values) || (NULL == queue->overflow) || (NULL == queue->overflow_pool)) {
+        bucket_queue_destroy(queue);
+        return NULL;
+    }
+    for (z = 1, nb_values = 0; z <= max_denominator; z++)
+        for (m = 0; m <= z; m++)
+            queue->values[nb_values++] = (float) m / (float) z;
+    qsort(queue->values, nb_values, sizeof(float), bucket_float_cmp);
+    for (i = 0, queue->nb_buckets = 0; i < nb_values; i++) {
+        if ((0 == queue->nb_buckets) || (queue->values[queue->nb_buckets - 1] != queue->values[i]))
+            queue->values[queue->nb_buckets++] = queue->values[i];
+    }
+
+    for (queue->slot_bits = 1; (((size_t) 1) << queue->slot_bits) < 2 * queue->nb_buckets; queue->slot_bits++);
+    queue->slots = calloc(((size_t) 1) << queue->slot_bits, sizeof(uint32_t));
+    queue->buckets = calloc(queue->nb_buckets, sizeof(struct bucket_t));
+    if ((NULL == queue->slots) || (NULL == queue->buckets)) {
+        bucket_queue_destroy(queue);
+        return NULL;
+    }
+    mask = (((size_t) 1) << queue->slot_bits) - 1;
+    for (i = 0; i < queue->nb_buckets; i++) {
+        for (slot = BUCKET_HASH(bucket_float_bits(queue->values[i]), queue->slot_bits); 0 != queue->slots[slot];
+             slot = (slot + 1) & mask);
+        queue->slots[slot] = i + 1;
+    }
+
+    return queue;
+}
+
+void bucket_queue_destroy(bucket_queue_t *queue)
+{
+    size_t i;
+
+    if (NULL != queue) {
+        if (NULL != queue->buckets) {
+            for (i = 0; i < queue->nb_buckets; i++)
+                free(queue->buckets[i].pairs);
+        }
+        free(queue->buckets);
+        free(queue->slots);
+        free(queue->values);
+        heap_destroy(queue->overflow);
+        pool_destroy(queue->overflow_pool);
+        free(queue);
+    }
+}
+
+int bucket_queue_insert(bucket_queue_t *queue, float value, size_t word_1, size_t word_2)
+{
+    struct bucket_t *bucket;
+    size_t b;
+
+    b = bucket_lookup(queue, value);
+    if (b == queue->nb_buckets) {
+        struct bucket_overflow_t *overflow;
+
+        if (NULL == (overflow = pool_alloc(queue->overflow_pool))) {
+            fprintf(stderr, "allocation failed\n");
+            return -1;
+        }
+        overflow->value = value;
+        overflow->word_1 = word_1;
+        overflow->word_2 = word_2;
+        if (0 != heap_insert(queue->overflow, overflow)) {
+            pool_free(queue->overflow_pool, overflow);
+            return -1;
+        }
+        queue->count++;
+        return 0;
+    }
+
+    bucket = queue->buckets + b;
+    if (bucket->count == bucket->max) {
+        struct bucket_pair_t *pairs;
+        size_t new_max = (0 == bucket->max) ? BUCKET_INITIAL_MAX : 2 * bucket->max;
+
+        if (NULL == (pairs = realloc(bucket->pairs, new_max * sizeof(struct bucket_pair_t)))) {
+            fprintf(stderr, "allocation failed\n");
+            return -1;
+        }
+        bucket->pairs = pairs;
+        bucket->max = new_max;
+    }
+    bucket->pairs[bucket->count].word_1 = word_1;
+    bucket->pairs[bucket->count].word_2 = word_2;
+    bucket->count++;
+    if (b >= queue->top)
+        queue->top = b + 1;
+    queue->count++;
+
+    return 0;
+}
+
+int bucket_queue_extract(bucket_queue_t *queue, float *value, size_t *word_1, size_t *word_2)
+{
+    struct bucket_overflow_t *overflow;
+    struct bucket_t *bucket;
+    struct bucket_pair_t *pair;
+
+    while ((queue->top > 0) && (queue->buckets[queue->top - 1].head == queue->buckets[queue->top - 1].count))
+        queue->top--;
+
+    bucket = (queue->top > 0) ? queue->buckets + queue->top - 1 : NULL;
+    pair = (NULL != bucket) ? bucket->pairs + bucket->head : NULL;
+    overflow = heap_get_nth(queue->overflow, 0);
+    if ((NULL != overflow)
+        && ((NULL == bucket)
+            || (bucket_pair_cmp(overflow->value, overflow->word_1, overflow->word_2, queue->values[queue->top - 1], pair->word_1,
+                                pair->word_2) > 0))) {
+        overflow = heap_extract(queue->overflow);
+        *value = overflow->value;
+        *word_1 = overflow->word_1;
+        *word_2 = overflow->word_2;
+        pool_free(queue->overflow_pool, overflow);
+        queue->count--;
+        return 0;
+    }
+    if (NULL == bucket)
+        return -1;
+
+    *value = queue->values[queue->top - 1];
+    *word_1 = pair->word_1;
+    *word_2 = pair->word_2;
+    /* A drained bucket gives its memory back. */
+    if (++bucket->head == bucket->count) {
+        free(bucket->pairs);
+        memset(bucket, 0, sizeof(struct bucket_t));
+    }
+    queue->count--;
+
+    return 0;
+}
+
+size_t bucket_queue_size(const bucket_queue_t *queue)
+{
+    return queue->count;
+}
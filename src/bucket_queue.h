@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef BUCKET_QUEUE_H
+#define BUCKET_QUEUE_H
+
+typedef struct bucket_queue_t bucket_queue_t;
+
+/**
+ * Make a new priority queue of pairs of words, returning the most similar
+ * pair first, and among pairs of equal similarity the smallest
+ * (word_1, word_2). Similarities m / z (computed as (float) m / (float) z)
+ * with z up to max_denominator have a bucket of their own, making insert and
+ * extract O(1); other values go through a binary heap.
+ * @param max_denominator The largest denominator getting buckets.
+ * @return Return a pointer to a newly allocated queue, NULL if an error
+ * occured.
+ * @remark Pairs of equal similarity must be inserted in increasing
+ * (word_1, word_2) order, since a bucket is a FIFO.
+ */
+bucket_queue_t *bucket_queue_make(size_t max_denominator);
+
+/**
+ * Deallocate the queue.
+ * @param queue The queue you are working with.
+ */
+void bucket_queue_destroy(bucket_queue_t *queue);
+
+/**
+ * Insert a pair in the queue.
+ * @param queue The queue you are working with.
+ * @param value The similarity of the pair.
+ * @param word_1 The index of the first word (smaller than 2^32).
+ * @param word_2 The index of the second word (smaller than 2^32).
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int bucket_queue_insert(bucket_queue_t *queue, float value, size_t word_1, size_t word_2);
+
+/**
+ * Extract the most similar pair of the queue.
+ * @param queue The queue you are working with.
+ * @param value Receives the similarity of the pair.
+ * @param word_1 Receives the index of the first word.
+ * @param word_2 Receives the index of the second word.
+ * @return 0 if a pair was extracted, -1 if the queue is empty.
+ */
+int bucket_queue_extract(bucket_queue_t *queue, float *value, size_t *word_1, size_t *word_2);
+
+/**
+ * Get the number of pairs in the queue.
+ * @param queue The queue you are working with.
+ * @return The number of pairs.
+ */
+size_t bucket_queue_size(const bucket_queue_t *queue);
+
+#endif /* BUCKET_QUEUE_H */
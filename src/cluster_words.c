@@ -19,24 +19,91 @@
 #include <string.h>
 #include <limits.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
-#include "heap.h"
+#include "bktree.h"
+#include "bucket_queue.h"
 #include "list.h"
+#include "lsh.h"
+#include "knn.h"
 #include "levenshtein.h"
 #include "mmap_wrapper.h"
+#include "nnchain.h"
+#include "pairsort.h"
+#include "qgram.h"
+#include "scheduler.h"
+#include "shard.h"
+#include "simstore.h"
+#include "stats.h"
+#include "stream.h"
+#include "union_find.h"
+#include "wordset.h"
 
 #define EPSILON 0.4
 #define IGNORE_SIZE 4
+/* Every similarity of words up to 256 characters has its own queue bucket. */
+#define QUEUE_MAX_DENOMINATOR 512
+/* Initial sizes of the word arena and of the word array. */
+#define ARENA_MIN_SIZE 65536
+#define WORDS_MIN 1024
+/* Chunks of the file per thread in the first pass, to even their load. */
+#define CHUNKS_PER_THREAD 4
+/* Words per tile of the third pass. */
+#define TILE_ROWS 64
+/*
+ * Tiles scored ahead of the one consumed, per thread. Tile costs only drift
+ * along the length-sorted triangle (the costliest of 763 tiles of 100k words
+ * is 0.5% of the pass), so with 2 per thread a thread finishing early finds a
+ * tile to take: replaying measured tile costs, 64 threads run 63.5 times as
+ * fast as one, against 63.7 without a window and 45.3 with 1 per thread.
+ */
+#define TILE_WINDOW 2
+/* Words compared to every other one to estimate the recall of --lsh. */
+#define LSH_RECALL_WORDS 64
+/* Clusters and list cells of the fourth pass come from slabs this large. */
+#define POOL_SLAB 4096
+
+/* Fourth pass: greedy merge of the pairs, most similar first. */
+#define ENGINE_GREEDY 0
+/* Fourth pass: complete linkage by nearest-neighbor chain. */
+#define ENGINE_NNCHAIN 1
 
+/*
+ * Clusters are chained in creation order, both ways so that a merged cluster
+ * leaves the chain in constant time.
+ */
 struct cluster_t {
     list_t *words;
+    struct cluster_t *prev, *next;
+    /* Rank of one of the words, naming the cluster in the rejection cache. */
+    size_t key;
+    /* A word of each cluster this one was found too far from. */
+    size_t *rejected;
+    size_t nb_rejected, max_rejected;
 };
 typedef struct cluster_t cluster_t;
 
+struct clusters_t {
+    cluster_t *first, *last;
+};
+typedef struct clusters_t clusters_t;
+
+/*
+ * Cluster membership belongs to a union-find over the word ranks: cluster is
+ * only meaningful on the root of a set, use word_cluster to reach it.
+ */
 struct word_t {
-    char *word;
+    const char *word;
+    /* Position of the word in the arena, while it is being loaded. */
+    size_t offset;
     size_t word_len;
     size_t idx;
+    /* Occurrences of the word in the file, case insensitively. */
+    size_t count;
     cluster_t *cluster;
 };
 typedef struct word_t word_t;
@@ -47,32 +114,586 @@ struct distance_t {
 };
 typedef struct distance_t distance_t;
 
-static int distance_cmp(const void *data1, const void *data2)
+struct options_t {
+    float cutoff;
+    size_t qgram;
+    int positional;
+    int bktree;
+    /* Neighbors of a word in the kNN graph, 0 to score every pair. */
+    size_t neighbors;
+    /* MinHash bands and rows of a band, 0 bands to score every pair. */
+    size_t bands, rows;
+    size_t threads;
+    int engine;
+    int stream;
+    /* File of the JSON statistics, NULL for none. */
+    const char *stats;
+    /* Memory budget of the pairs sorted out of core, 0 to keep them in a queue. */
+    size_t mem_limit;
+    const char *scratch_dir;
+    /* Score shard shard of nb_shards only (0 shards: every tile), into shard_dir. */
+    size_t shard, nb_shards;
+    /* Cluster the pairs of that many shards found in shard_dir, 0 to score them. */
+    size_t merge_shards;
+    const char *shard_dir;
+};
+typedef struct options_t options_t;
+
+/*
+ * Third pass: the triangle of pairs is cut in tiles of TILE_ROWS words (with
+ * every following word), scored by the scheduler threads. Each tile keeps the
+ * pairs it found, in (word_1, word_2) order, and tiles are consumed in order,
+ * so the pairs reach the queue exactly as a serial run would insert them.
+ * Tiles only start TILE_WINDOW per thread ahead of the one consumed, and with
+ * a memory budget the tiles after the oldest one also wait while the pairs
+ * held by every tile would exceed it.
+ */
+struct scored_pair_t {
+    uint32_t word_1, word_2;
+    float value;
+};
+typedef struct scored_pair_t scored_pair_t;
+
+struct tile_t {
+    scored_pair_t *pairs;
+    size_t nb_pairs, max_pairs;
+    size_t nb_pruned, nb_filtered, nb_below;
+};
+typedef struct tile_t tile_t;
+
+/* Work area of a thread. */
+struct scorer_t {
+    qgram_search_t *search;
+    bktree_search_t *tree_search;
+    size_t *candidates;
+    float *scores;
+};
+typedef struct scorer_t scorer_t;
+
+struct scoring_t {
+    const options_t *opts;
+    const word_t *words;
+    const char * const *word_ptrs;
+    const size_t *word_lens;
+    size_t nb_words;
+    const qgram_index_t *index;
+    const bktree_t *tree;
+    knn_t *knn;
+    const lsh_t *lsh;
+    scorer_t *scorers;
+    /* Task t scores the rows of tile first_tile + t * tile_step. */
+    size_t first_tile, tile_step;
+    tile_t *tiles;
+    /* Bytes of pairs held by the tiles, and their budget (0 for none); task oldest is never held back. */
+    pthread_mutex_t mutex;
+    pthread_cond_t released;
+    size_t held, budget, oldest;
+};
+typedef struct scoring_t scoring_t;
+
+struct printer_t {
+    const word_t *words;
+    size_t nb_clusters;
+    stats_t *stats;
+};
+typedef struct printer_t printer_t;
+
+/* First pass: the words found in each chunk of the file. */
+struct chunk_t {
+    word_t *words;
+    size_t nb_words, max_words;
+    /* Words not longer than IGNORE_SIZE. */
+    size_t nb_skipped;
+};
+typedef struct chunk_t chunk_t;
+
+struct loading_t {
+    const mmap_wrapper_t *mw;
+    chunk_t *chunks;
+    size_t nb_chunks;
+};
+typedef struct loading_t loading_t;
+
+static int index_cmp(const void *data1, const void *data2)
+{
+    size_t i1 = *(const size_t *) data1;
+    size_t i2 = *(const size_t *) data2;
+
+    return (i1 < i2) ? -1 : ((i1 > i2) ? 1 : 0);
+}
+
+/* Shortest words first, in load order for a given length. */
+static int word_cmp(const void *data1, const void *data2)
+{
+    const word_t *w1 = data1;
+    const word_t *w2 = data2;
+
+    if (w1->word_len != w2->word_len)
+        return (w1->word_len < w2->word_len) ? -1 : 1;
+
+    return (w1->idx < w2->idx) ? -1 : ((w1->idx > w2->idx) ? 1 : 0);
+}
+
+/* Report the wall time of a pass, and start timing the next one. */
+static void pass_done(const char *pass, stats_t *stats)
+{
+    fprintf(stderr, "%s pass: %.3f s\n", pass, stats_pass_done(stats));
+}
+
+/* First word after i not longer than word_len / cutoff. */
+static inline size_t window_end(const scoring_t *scoring, size_t i)
+{
+    size_t lo, hi, mid;
+
+    if (scoring->opts->cutoff <= 0.0)
+        return scoring->nb_words;
+    for (lo = i + 1, hi = scoring->nb_words; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+        if ((float) scoring->word_lens[i] / (float) scoring->word_lens[mid] >= scoring->opts->cutoff)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static inline cluster_t *word_cluster(word_t *words, union_find_t *sets, size_t word)
+{
+    return words[union_find_find(sets, word)].cluster;
+}
+
+static inline void clusters_append(clusters_t *clusters, cluster_t *cluster)
+{
+    cluster->prev = clusters->last;
+    cluster->next = NULL;
+    if (NULL != clusters->last)
+        clusters->last->next = cluster;
+    else
+        clusters->first = cluster;
+    clusters->last = cluster;
+}
+
+static inline void clusters_unlink(clusters_t *clusters, cluster_t *cluster)
+{
+    if (NULL != cluster->prev)
+        cluster->prev->next = cluster->next;
+    else
+        clusters->first = cluster->next;
+    if (NULL != cluster->next)
+        cluster->next->prev = cluster->prev;
+    else
+        clusters->last = cluster->prev;
+}
+
+static void print_word(const word_t *word)
+{
+    if (word->count > 1)
+        fprintf(stdout, "[%.*s]x%zu ", (int) word->word_len, word->word, word->count);
+    else
+        fprintf(stdout, "[%.*s] ", (int) word->word_len, word->word);
+}
+
+static int print_cluster(void *ctx, const size_t *points, size_t nb_points)
+{
+    printer_t *printer = ctx;
+    size_t p;
+
+    fprintf(stdout, "Cluster %zi: ", printer->nb_clusters++);
+    stats_cluster(printer->stats, nb_points);
+    for (p = 0; p < nb_points; p++)
+        print_word(printer->words + points[p]);
+    fprintf(stdout, "\n");
+
+    return 0;
+}
+
+static int cluster_reject(cluster_t *cluster, size_t word)
+{
+    size_t *rejected;
+    size_t new_max;
+
+    if (cluster->nb_rejected == cluster->max_rejected) {
+        new_max = (0 == cluster->max_rejected) ? 4 : 2 * cluster->max_rejected;
+        if (NULL == (rejected = realloc(cluster->rejected, new_max * sizeof(size_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        cluster->rejected = rejected;
+        cluster->max_rejected = new_max;
+    }
+    cluster->rejected[cluster->nb_rejected++] = word;
+
+    return 0;
+}
+
+/*
+ * Two clusters are rejected once some pair of their words is below EPSILON,
+ * which stays true as they grow: the cache keeps, for each rejected pair of
+ * clusters, the similarity that failed. A merged cluster is rejected by the
+ * union of the clusters rejecting its halves, with the smallest of the two
+ * similarities (Lance-Williams update of complete linkage). It keeps the key
+ * of the half with most rejections, only those of the other are moved.
+ */
+static int cluster_merge_rejections(word_t *words, union_find_t *sets, simstore_t *rejections, cluster_t *cluster_1,
+                                    cluster_t *cluster_2)
+{
+    cluster_t *big, *small, *partner;
+    size_t r, *swap;
+    float value, known;
+
+    big = (cluster_1->nb_rejected >= cluster_2->nb_rejected) ? cluster_1 : cluster_2;
+    small = (big == cluster_1) ? cluster_2 : cluster_1;
+    for (r = 0; r < small->nb_rejected; r++) {
+        partner = word_cluster(words, sets, small->rejected[r]);
+        if ((partner == cluster_1) || (partner == cluster_2))
+            continue;
+        value = simstore_get(rejections, small->key, partner->key);
+        known = simstore_get(rejections, big->key, partner->key);
+        if (SIMSTORE_BELOW != known) {
+            if (known <= value)
+                continue;
+        }
+        else if (0 != cluster_reject(big, small->rejected[r])) {
+            return -1;
+        }
+        if (0 != simstore_set(rejections, big->key, partner->key, value))
+            return -1;
+    }
+
+    /* The merged cluster lives in cluster_1. */
+    if (big == cluster_2) {
+        swap = cluster_1->rejected;
+        cluster_1->rejected = cluster_2->rejected;
+        cluster_2->rejected = swap;
+        cluster_1->nb_rejected = cluster_2->nb_rejected;
+        cluster_1->max_rejected = cluster_2->max_rejected;
+        cluster_1->key = cluster_2->key;
+    }
+    free(cluster_2->rejected);
+    cluster_2->rejected = NULL;
+
+    return 0;
+}
+
+/* Count size more bytes held by the tile of task, over budget once the tiles before it release some. */
+static void tiles_charge(scoring_t *scoring, size_t task, size_t size)
+{
+    pthread_mutex_lock(&scoring->mutex);
+    while ((0 != scoring->budget) && (task > scoring->oldest) && (scoring->held + size > scoring->budget))
+        pthread_cond_wait(&scoring->released, &scoring->mutex);
+    scoring->held += size;
+    pthread_mutex_unlock(&scoring->mutex);
+}
+
+/* Count size bytes released by a consumed tile, oldest being the next one to consume. */
+static void tiles_release(scoring_t *scoring, size_t oldest, size_t size)
+{
+    pthread_mutex_lock(&scoring->mutex);
+    scoring->held -= size;
+    scoring->oldest = oldest;
+    pthread_cond_broadcast(&scoring->released);
+    pthread_mutex_unlock(&scoring->mutex);
+}
+
+static int score_tile(void *ctx, size_t thread, size_t task)
 {
-    const distance_t *d1 = data1;
-    const distance_t *d2 = data2;
+    scoring_t *scoring = ctx;
+    const options_t *opts = scoring->opts;
+    const word_t *words = scoring->words;
+    scorer_t *scorer = scoring->scorers + thread;
+    tile_t *tile = scoring->tiles + task;
+    size_t i, j, c, end, first, last, nb_candidates, nb_found, max_edits;
+
+    first = (scoring->first_tile + task * scoring->tile_step) * TILE_ROWS;
+    last = first + TILE_ROWS;
+    last = (last < scoring->nb_words) ? last : scoring->nb_words;
+    if (NULL != scoring->knn) {
+        /* The rows of the graph: its edges come out once every row is built. */
+        knn_build(scoring->knn, first, last, &tile->nb_pruned, &tile->nb_below);
+        return 0;
+    }
+    for (i = first, end = window_end(scoring, i); i < last; i++) {
+        /* The window end only moves forward with the word length. */
+        if (end < i + 1)
+            end = i + 1;
+        while ((end < scoring->nb_words) && ((float) words[i].word_len / (float) words[end].word_len >= opts->cutoff))
+            end++;
+        tile->nb_pruned += scoring->nb_words - end;
+        if (NULL != scoring->index) {
+            /* Only the words sharing enough q-grams with word i. */
+            nb_candidates = qgram_candidates(scoring->index, scorer->search, i, end, opts->cutoff, scorer->candidates);
+            tile->nb_filtered += end - i - 1 - nb_candidates;
+        }
+        else if (NULL != scoring->lsh) {
+            /* Only the words sharing a band of their MinHash signatures with word i. */
+            nb_candidates = lsh_candidates(scoring->lsh, i, end, scorer->candidates);
+            tile->nb_filtered += end - i - 1 - nb_candidates;
+        }
+        else if ((NULL != scoring->tree) && (end > i + 1)) {
+            /* Only the words within the edits allowed with the longest word of the window. */
+            max_edits = levenshtein_max_edits(words[i].word_len, words[end - 1].word_len, opts->cutoff);
+            nb_found = bktree_within(scoring->tree, scorer->tree_search, words[i].word, words[i].word_len, max_edits,
+                                     scorer->candidates);
+            for (c = 0, nb_candidates = 0; c < nb_found; c++) {
+                if ((scorer->candidates[c] > i) && (scorer->candidates[c] < end))
+                    scorer->candidates[nb_candidates++] = scorer->candidates[c];
+            }
+            qsort(scorer->candidates, nb_candidates, sizeof(size_t), index_cmp);
+            tile->nb_filtered += end - i - 1 - nb_candidates;
+        }
+        else {
+            for (j = i + 1, nb_candidates = 0; j < end; j++)
+                scorer->candidates[nb_candidates++] = j;
+        }
+        if (opts->cutoff > 0.0) {
+            /* Pairs below the cutoff are never compared in full nor clustered. */
+            for (c = 0; c < nb_candidates; c++) {
+                j = scorer->candidates[c];
+                scorer->scores[c] = levenshtein_norm_distance_bounded(words[i].word, words[i].word_len, words[j].word, words[j].word_len,
+                                                                      opts->cutoff);
+            }
+        }
+        else {
+            /* One-vs-many: word i against every following word at once. */
+            levenshtein_norm_distance_batch(words[i].word, words[i].word_len, scoring->word_ptrs + i + 1, scoring->word_lens + i + 1,
+                                            nb_candidates, scorer->scores);
+        }
+        for (c = 0; c < nb_candidates; c++) {
+            if (scorer->scores[c] == LEVENSHTEIN_BELOW) {
+                tile->nb_below++;
+                continue;
+            }
+            if (tile->nb_pairs == tile->max_pairs) {
+                scored_pair_t *pairs;
+                size_t new_max = (0 == tile->max_pairs) ? 256 : 2 * tile->max_pairs;
+
+                tiles_charge(scoring, task, (new_max - tile->max_pairs) * sizeof(scored_pair_t));
+                if (NULL == (pairs = realloc(tile->pairs, new_max * sizeof(scored_pair_t)))) {
+                    perror("realloc");
+                    return -1;
+                }
+                tile->pairs = pairs;
+                tile->max_pairs = new_max;
+            }
+            tile->pairs[tile->nb_pairs].word_1 = i;
+            tile->pairs[tile->nb_pairs].word_2 = scorer->candidates[c];
+            tile->pairs[tile->nb_pairs].value = scorer->scores[c];
+            tile->nb_pairs++;
+        }
+    }
+
+    return 0;
+}
+
+static int sign_tile(void *ctx, size_t thread, size_t task)
+{
+    (void) thread;
+    lsh_sign(ctx, task * TILE_ROWS, (task + 1) * TILE_ROWS);
+
+    return 0;
+}
+
+static int words_append(word_t **words, size_t *nb_words, size_t *max_words, const char *word, size_t len)
+{
+    word_t *new_words;
+
+    if (*nb_words == *max_words) {
+        *max_words = (0 == *max_words) ? WORDS_MIN : 2 * *max_words;
+        if (NULL == (new_words = realloc(*words, *max_words * sizeof(struct word_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        *words = new_words;
+    }
+    (*words)[*nb_words].word = word;
+    (*words)[*nb_words].word_len = len;
+    (*words)[*nb_words].idx = *nb_words;
+    (*words)[*nb_words].count = 1;
+    (*words)[*nb_words].cluster = NULL;
+    (*nb_words)++;
+
+    return 0;
+}
+
+static int load_chunk(void *ctx, size_t thread, size_t task)
+{
+    loading_t *loading = ctx;
+    chunk_t *chunk = loading->chunks + task;
+    mmap_chunk_t it;
+    const char *word;
+    size_t len;
+
+    (void) thread;
+    if (0 != mmap_chunk_init(loading->mw, &it, task, loading->nb_chunks, "\r\n\t"))
+        return -1;
+    while (NULL != (word = mmap_chunk_next(loading->mw, &it, &len))) {
+        if (len <= IGNORE_SIZE)
+            chunk->nb_skipped++;
+        else if (0 != words_append(&chunk->words, &chunk->nb_words, &chunk->max_words, word, len))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Words of a file mapped whole, in file order, tokenized by chunks on the threads. */
+static word_t *load_words(const mmap_wrapper_t *mw, size_t nb_threads, size_t *nb_words, size_t *nb_skipped)
+{
+    loading_t loading;
+    scheduler_t *scheduler;
+    word_t *words;
+    size_t t, w;
+    int rv;
+
+    loading.mw = mw;
+    loading.nb_chunks = (nb_threads > 1) ? nb_threads * CHUNKS_PER_THREAD : 1;
+    if (NULL == (loading.chunks = calloc(loading.nb_chunks, sizeof(chunk_t))))
+        return NULL;
+    if (NULL == (scheduler = scheduler_start(nb_threads, loading.nb_chunks, 0, load_chunk, &loading))) {
+        free(loading.chunks);
+        return NULL;
+    }
+    rv = scheduler_join(scheduler);
+
+    for (t = 0, *nb_words = 0, *nb_skipped = 0; t < loading.nb_chunks; t++) {
+        *nb_words += loading.chunks[t].nb_words;
+        *nb_skipped += loading.chunks[t].nb_skipped;
+    }
+    words = (0 == rv) ? malloc((*nb_words + 1) * sizeof(struct word_t)) : NULL;
+    for (t = 0, w = 0; t < loading.nb_chunks; t++) {
+        if (NULL != words)
+            memcpy(words + w, loading.chunks[t].words, loading.chunks[t].nb_words * sizeof(struct word_t));
+        w += loading.chunks[t].nb_words;
+        free(loading.chunks[t].words);
+    }
+    free(loading.chunks);
+    for (w = 0; (NULL != words) && (w < *nb_words); w++)
+        words[w].idx = w;
+
+    return words;
+}
+
+/*
+ * Keep the first occurrence of each word (case insensitively), counting the
+ * others: duplicates would only be clustered together at similarity 1.
+ */
+static int dedupe_words(word_t *words, size_t *nb_words)
+{
+    wordset_t *set;
+    size_t w, kept, found;
+    int rv;
+
+    if (NULL == (set = wordset_make(*nb_words)))
+        return -1;
+    for (w = 0, kept = 0; w < *nb_words; w++) {
+        rv = wordset_add(set, words[w].word, words[w].word_len, kept, &found);
+        if (rv < 0) {
+            wordset_destroy(set);
+            return -1;
+        }
+        if (0 == rv) {
+            words[found].count += words[w].count;
+            continue;
+        }
+        words[kept] = words[w];
+        words[kept].idx = kept;
+        kept++;
+    }
+    wordset_destroy(set);
+    *nb_words = kept;
+
+    return 0;
+}
+
+/*
+ * Similarity of two words for the merge check, SIMSTORE_BELOW below EPSILON.
+ * Pairs sorted out of core have no store: a pair was stored if it reached
+ * both the cutoff and EPSILON, which the bounded distance tells again.
+ */
+static float pair_similarity(const simstore_t *similarity, const options_t *opts, const word_t *word1, const word_t *word2)
+{
+    const word_t *swap;
+
+    if (NULL != similarity)
+        return simstore_get(similarity, word1->idx, word2->idx);
+    if (word1->idx > word2->idx) {
+        swap = word1;
+        word1 = word2;
+        word2 = swap;
+    }
+
+    return levenshtein_norm_distance_bounded(word1->word, word1->word_len, word2->word, word2->word_len,
+                                             (opts->cutoff > EPSILON) ? opts->cutoff : EPSILON);
+}
+
+/* Hand a scored pair to the fourth pass. */
+static int store_pair(nnchain_t *nnchain, pairsort_t *sorter, simstore_t *similarity, bucket_queue_t *queue, float value, size_t word_1,
+                      size_t word_2)
+{
+    if (NULL != nnchain) {
+        if ((value >= EPSILON) && (0 != nnchain_add(nnchain, word_1, word_2, value))) {
+            fprintf(stderr, "error calling nnchain_add\n");
+            return -1;
+        }
+    }
+    else if (NULL != sorter) {
+        if (0 != pairsort_insert(sorter, value, word_1, word_2)) {
+            fprintf(stderr, "error calling pairsort_insert\n");
+            return -1;
+        }
+    }
+    else if (0 != simstore_set(similarity, word_1, word_2, value)) {
+        fprintf(stderr, "error calling simstore_set\n");
+        return -1;
+    }
+    else if (0 != bucket_queue_insert(queue, value, word_1, word_2)) {
+        fprintf(stderr, "error calling bucket_queue_insert\n");
+        return -1;
+    }
 
-    return (d1->value > d2->value) ? 1 : ((d1->value < d2->value) ? -1 : 0);
+    return 0;
 }
 
-static void distance_del(void *data)
+/* Next pair of the fourth pass: 1 if there is one, 0 if there is none left, -1 if an error occured. */
+static int next_pair(bucket_queue_t *queue, pairsort_t *sorter, float *value, size_t *word_1, size_t *word_2)
 {
-    distance_t *d = data;
-    free(d);
+    if (NULL != sorter)
+        return pairsort_extract(sorter, value, word_1, word_2);
+
+    return (0 == bucket_queue_extract(queue, value, word_1, word_2)) ? 1 : 0;
 }
 
-static inline int process_file(const char *file)
+static inline int process_file(const char *file, const options_t *opts, stats_t *stats)
 {
-    heap_t *heap;
+    bucket_queue_t *queue;
+    pairsort_t *sorter;
     mmap_wrapper_t *mw;
-    list_t *clusters;
-    cluster_t *cluster;
-    cell_t *cell;
+    clusters_t clusters;
+    cluster_t *cluster, *cluster_1, *cluster_2;
+    union_find_t *sets;
+    pool_t *cluster_pool, *cells;
     word_t *words;
-    distance_t *d;
-    const char *word;
-    float *similarity;
-    size_t i, j, idx, len, nb_words;
+    distance_t *d, distance;
+    qgram_index_t *index;
+    bktree_t *tree;
+    knn_t *knn;
+    knn_edge_t *edges;
+    lsh_t *lsh;
+    scheduler_t *scheduler;
+    scoring_t scoring;
+    tile_t *tile;
+    shard_t *shard, **shards;
+    shard_info_t info;
+    shard_tile_t counters;
+    const char *word, **word_ptrs;
+    char *arena;
+    simstore_t *similarity, *rejections;
+    nnchain_t *nnchain;
+    printer_t printer;
+    size_t i, j, c, t, nb_threads, nb_tiles, nb_tasks, first, last, word_1, word_2, idx, len, nb_words, max_words, arena_size, arena_max, *word_lens;
+    size_t nb_pairs, nb_pruned, nb_filtered, nb_below, nb_stored, nb_merged, nb_scanned, nb_cached, nb_edges;
+    float value;
     int rv;
 
     rv = mmap_wrapper_init(&mw, file);
@@ -81,172 +702,877 @@ static inline int process_file(const char *file)
         return -1;
     }
 
-    /* First pass: count words. */
+    /*
+     * First pass: when the whole file is mapped, words are views of the
+     * mapping, kept until the end, and chunks of the file are tokenized by
+     * the threads. Otherwise copy them one after the other (each with a final
+     * NUL) in a single arena, which grows as needed, word_t holding their
+     * offsets until it stops moving.
+     */
     fprintf(stderr, "first pass\n");
-    for (nb_words = 0, rv = mmap_get_head(mw, &idx); 0 == rv; rv = mmap_get_next2(mw, &idx, "\r\n\t"), nb_words++) {
-        word = mmap_get_line2(mw, &idx, &len, "\r\n\t");
-        if (NULL == word) {
-            fprintf(stderr, "error calling mmap_get_line on file %s idx: %lu\n", file, idx);
+    arena = NULL;
+    words = NULL;
+    nb_words = 0;
+    if (mmap_wrapper_whole(mw)) {
+        if (NULL == (words = load_words(mw, opts->threads, &nb_words, &stats->nb_skipped))) {
+            fprintf(stderr, "error loading the words of file %s\n", file);
             mmap_wrapper_delete(mw);
             return -1;
         }
-        if (0 == len)
-            continue;
     }
+    else {
+        arena_size = arena_max = 0;
+        max_words = 0;
+        for (rv = mmap_get_head(mw, &idx); 0 == rv; rv = mmap_get_next2(mw, &idx, "\r\n\t")) {
+            word = mmap_get_line2(mw, &idx, &len, "\r\n\t");
+            if (NULL == word) {
+                fprintf(stderr, "error calling mmap_get_line on file %s idx: %lu\n", file, idx);
+                mmap_wrapper_delete(mw);
+                return -1;
+            }
+            if (len <= IGNORE_SIZE) {
+                stats->nb_skipped++;
+                continue;
+            }
+            if (arena_size + len + 1 > arena_max) {
+                char *new_arena;
 
-    words = calloc(nb_words, sizeof(struct word_t));
-    similarity = calloc(nb_words * nb_words, sizeof(float));
+                for (arena_max = (0 == arena_max) ? ARENA_MIN_SIZE : arena_max; arena_size + len + 1 > arena_max; arena_max *= 2);
+                if (NULL == (new_arena = realloc(arena, arena_max))) {
+                    perror("realloc");
+                    mmap_wrapper_delete(mw);
+                    return -1;
+                }
+                arena = new_arena;
+            }
+            if (0 != words_append(&words, &nb_words, &max_words, word, len)) {
+                mmap_wrapper_delete(mw);
+                return -1;
+            }
+            memcpy(arena + arena_size, word, len);
+            arena[arena_size + len] = '\0';
+            words[nb_words - 1].offset = arena_size;
+            arena_size += len + 1;
+        }
+        mmap_wrapper_delete(mw);
+        mw = NULL;
+        for (i = 0; i < nb_words; i++)
+            words[i].word = arena + words[i].offset;
+    }
+    len = nb_words;
+    if (0 != dedupe_words(words, &nb_words)) {
+        fprintf(stderr, "error removing the duplicate words of file %s\n", file);
+        return -1;
+    }
+    fprintf(stderr, "%zu words, %zu distinct\n", len, nb_words);
+    stats->nb_loaded = len;
+    stats->nb_duplicates = len - nb_words;
+    pass_done("first", stats);
+    word_ptrs = malloc((nb_words + 1) * sizeof(char *));
+    word_lens = malloc((nb_words + 1) * sizeof(size_t));
+    if ((NULL == word_ptrs) || (NULL == word_lens)) {
+        fprintf(stderr, "error allocating the words of file %s\n", file);
+        return -1;
+    }
 
-    /* Second pass: get words. */
+    /* Second pass: sort the words and allocate the pair structures. */
     fprintf(stderr, "second pass\n");
-    for (nb_words = 0, rv = mmap_get_head(mw, &idx); 0 == rv; rv = mmap_get_next2(mw, &idx, "\r\n\t"), nb_words++) {
-        word = mmap_get_line2(mw, &idx, &len, "\r\n\t");
-        if (NULL == word) {
-            fprintf(stderr, "error calling mmap_get_line on file %s idx: %lu\n", file, idx);
-            mmap_wrapper_delete(mw);
+    /*
+     * Sort words by length: the similarity of two words can't exceed the
+     * ratio of their lengths, so the words worth comparing to a given one
+     * are a window of the array. From now on idx is the rank in that order.
+     */
+    qsort(words, nb_words, sizeof(struct word_t), word_cmp);
+    for (i = 0; i < nb_words; i++)
+        words[i].idx = i;
+
+    queue = NULL;
+    similarity = NULL;
+    sorter = NULL;
+    nnchain = NULL;
+    if (0 != opts->nb_shards) {
+        /* The pairs of a shard only go to its file. */
+    }
+    else if (ENGINE_NNCHAIN == opts->engine) {
+        /* The chain only needs the pairs which may share a cluster. */
+        if (NULL == (nnchain = nnchain_make(nb_words))) {
+            fprintf(stderr, "error calling nnchain_make\n");
             return -1;
         }
-        if(len > IGNORE_SIZE) {
-            words[nb_words].word = strndup(word, len);
-            words[nb_words].word_len = len;
-            words[nb_words].idx = nb_words;
-        } else {
-            nb_words--;
+    }
+    else if (0 != opts->mem_limit) {
+        /*
+         * Runs of sorted pairs in a scratch file, and no store: the merge
+         * check computes again. Half of the budget goes to the tiles.
+         */
+        if (NULL == (sorter = pairsort_make(opts->scratch_dir, opts->mem_limit - opts->mem_limit / 2))) {
+            fprintf(stderr, "error calling pairsort_make in %s\n", opts->scratch_dir);
+            return -1;
+        }
+    }
+    else {
+        /* Pairs are inserted by increasing (word_1, word_2), as the queue requires. */
+        len = (0 == nb_words) ? 0 : 2 * words[nb_words - 1].word_len;
+        queue = bucket_queue_make((len < QUEUE_MAX_DENOMINATOR) ? len : QUEUE_MAX_DENOMINATOR);
+        /* The merge check only needs to know which pairs are not below EPSILON. */
+        similarity = simstore_make(EPSILON);
+        if ((NULL == queue) || (NULL == similarity)) {
+            fprintf(stderr, "error allocating the similarity queue and store\n");
+            return -1;
         }
-        if (0 == len)
-            continue;
     }
-    mmap_wrapper_delete(mw);
 
-    heap = heap_make(distance_cmp, distance_del);
+    pass_done("second", stats);
 
     /* Third pass: get words distances. */
     fprintf(stderr, "third pass\n");
     for (i = 0; i < nb_words; i++) {
-        similarity[i + i * nb_words] = 1.0;
-        for (j = i + 1; j < nb_words; j++) {
-            d = malloc(sizeof(struct distance_t));
-            similarity[i + j * nb_words] = levenshtein_norm_distance(words[i].word, words[i].word_len, words[j].word, words[j].word_len);
-            similarity[j + i * nb_words] = similarity[i + j * nb_words];
-            d->value = similarity[i + j *nb_words];
-            d->word_1 = i;
-            d->word_2 = j;
-            heap_insert(heap, d);
+        word_ptrs[i] = words[i].word;
+        word_lens[i] = words[i].word_len;
+    }
+    nb_tiles = (nb_words + TILE_ROWS - 1) / TILE_ROWS;
+    info.shard = opts->shard;
+    info.nb_shards = (0 != opts->nb_shards) ? opts->nb_shards : opts->merge_shards;
+    info.nb_words = nb_words;
+    info.tile_rows = TILE_ROWS;
+    info.words_hash = shard_words_hash(word_ptrs, word_lens, nb_words);
+    info.cutoff = opts->cutoff;
+    info.qgram = opts->qgram;
+    info.positional = (0 != opts->qgram) && opts->positional;
+    info.bktree = opts->bktree;
+    info.bands = opts->bands;
+    info.rows = opts->rows;
+    shard = NULL;
+    shards = NULL;
+    if (0 != opts->nb_shards) {
+        if (NULL == (shard = shard_create(opts->shard_dir, &info))) {
+            fprintf(stderr, "error creating shard %zu of %zu in %s\n", opts->shard, opts->nb_shards, opts->shard_dir);
+            return -1;
+        }
+    }
+    else if (0 != opts->merge_shards) {
+        /* Check every shard is there before clustering any pair. */
+        if (NULL == (shards = calloc(opts->merge_shards, sizeof(shard_t *)))) {
+            perror("calloc");
+            return -1;
+        }
+        for (info.shard = 0; info.shard < opts->merge_shards; info.shard++) {
+            if (NULL == (shards[info.shard] = shard_open(opts->shard_dir, &info))) {
+                fprintf(stderr, "error opening shard %zu of %zu in %s\n", info.shard, opts->merge_shards, opts->shard_dir);
+                return -1;
+            }
+        }
+    }
+    /* A merge only checks the filter of the shards, its pairs are filtered already. */
+    index = NULL;
+    if ((0 != opts->qgram) && (0 == opts->merge_shards)) {
+        index = qgram_index_make(word_ptrs, word_lens, nb_words, opts->qgram, opts->positional);
+        if (NULL == index) {
+            fprintf(stderr, "error calling qgram_index_make on file %s\n", file);
+            return -1;
+        }
+    }
+    knn = NULL;
+    if (0 != opts->neighbors) {
+        if (NULL == (knn = knn_make(word_ptrs, word_lens, nb_words, opts->neighbors, opts->cutoff))) {
+            fprintf(stderr, "error calling knn_make on file %s\n", file);
+            return -1;
+        }
+    }
+    lsh = NULL;
+    if ((0 != opts->bands) && (0 == opts->merge_shards)) {
+        /* Signatures by tiles on every thread, then the buckets of each band. */
+        lsh = lsh_make(word_ptrs, word_lens, nb_words, opts->bands, opts->rows);
+        scheduler = (NULL != lsh) ? scheduler_start(opts->threads, (nb_words + TILE_ROWS - 1) / TILE_ROWS, 0, sign_tile, lsh) : NULL;
+        if ((NULL == scheduler) || (0 != scheduler_join(scheduler)) || (0 != lsh_bucket(lsh))) {
+            fprintf(stderr, "error hashing the words of file %s\n", file);
+            return -1;
+        }
+        fprintf(stderr, "%zu candidate pairs in %zu bands of %zu rows\n", lsh_nb_candidates(lsh), opts->bands, opts->rows);
+        lsh_oversized(lsh, &stats->lsh_oversized, &stats->lsh_skipped);
+        if (0 != stats->lsh_oversized)
+            fprintf(stderr, "%zu buckets of more than %d words, %zu of their pairs skipped\n", stats->lsh_oversized, LSH_MAX_BUCKET,
+                    stats->lsh_skipped);
+    }
+    tree = NULL;
+    if (opts->bktree && (0 == opts->merge_shards)) {
+        if (NULL == (tree = bktree_make(word_ptrs, word_lens, nb_words))) {
+            fprintf(stderr, "error calling bktree_make on file %s\n", file);
+            return -1;
+        }
+    }
+    nb_threads = (opts->threads > 1) ? opts->threads : 1;
+    /*
+     * A shard scores every nb_shards-th tile, the long rows of the first
+     * tiles spread over the shards. A merge scores nothing: its tiles are
+     * read from the shards once the scheduler is joined.
+     */
+    scoring.first_tile = 0;
+    scoring.tile_step = 1;
+    nb_tasks = nb_tiles;
+    if (0 != opts->nb_shards) {
+        scoring.first_tile = opts->shard;
+        scoring.tile_step = opts->nb_shards;
+        nb_tasks = (nb_tiles + opts->nb_shards - 1 - opts->shard) / opts->nb_shards;
+    }
+    else if (0 != opts->merge_shards) {
+        nb_tasks = 0;
+    }
+    scoring.opts = opts;
+    scoring.words = words;
+    scoring.word_ptrs = word_ptrs;
+    scoring.word_lens = word_lens;
+    scoring.nb_words = nb_words;
+    scoring.index = index;
+    scoring.tree = tree;
+    scoring.knn = knn;
+    scoring.lsh = lsh;
+    scoring.scorers = calloc(nb_threads, sizeof(scorer_t));
+    scoring.tiles = calloc(nb_tasks + 1, sizeof(tile_t));
+    if ((NULL == scoring.scorers) || (NULL == scoring.tiles)) {
+        fprintf(stderr, "error allocating the third pass tiles\n");
+        return -1;
+    }
+    pthread_mutex_init(&scoring.mutex, NULL);
+    pthread_cond_init(&scoring.released, NULL);
+    scoring.held = scoring.oldest = 0;
+    scoring.budget = (NULL != sorter) ? opts->mem_limit / 2 : 0;
+    for (t = 0; t < nb_threads; t++) {
+        scoring.scorers[t].candidates = malloc((nb_words + 1) * sizeof(size_t));
+        scoring.scorers[t].scores = malloc((nb_words + 1) * sizeof(float));
+        scoring.scorers[t].search = (NULL != index) ? qgram_search_make(index) : NULL;
+        scoring.scorers[t].tree_search = (NULL != tree) ? bktree_search_make(tree) : NULL;
+        if ((NULL == scoring.scorers[t].candidates) || (NULL == scoring.scorers[t].scores)
+            || ((NULL != index) && (NULL == scoring.scorers[t].search))
+            || ((NULL != tree) && (NULL == scoring.scorers[t].tree_search))) {
+            fprintf(stderr, "error allocating the third pass work areas\n");
+            return -1;
+        }
+    }
+
+    scheduler = scheduler_start(opts->threads, nb_tasks, TILE_WINDOW * nb_threads, score_tile, &scoring);
+    if (NULL == scheduler) {
+        fprintf(stderr, "error calling scheduler_start\n");
+        return -1;
+    }
+    nb_pairs = (0 == nb_words) ? 0 : nb_words * (nb_words - 1) / 2;
+    nb_pruned = nb_filtered = nb_below = nb_stored = 0;
+    if (NULL != shard)
+        nb_pairs = 0;
+    for (t = 0, rv = 0; (t < nb_tasks) && (0 == rv); t++) {
+        rv = scheduler_wait(scheduler, t);
+        tile = scoring.tiles + t;
+        if (NULL != shard) {
+            /* Each row of the tile pairs with every following word. */
+            counters.tile = scoring.first_tile + t * scoring.tile_step;
+            first = counters.tile * TILE_ROWS;
+            last = (first + TILE_ROWS < nb_words) ? first + TILE_ROWS : nb_words;
+            nb_pairs += (last - first) * (nb_words - 1) - (first + last - 1) * (last - first) / 2;
+            counters.nb_pairs = tile->nb_pairs;
+            counters.nb_pruned = tile->nb_pruned;
+            counters.nb_filtered = tile->nb_filtered;
+            counters.nb_below = tile->nb_below;
+            if (0 == rv)
+                rv = shard_write_tile(shard, &counters);
+        }
+        for (c = 0; (c < tile->nb_pairs) && (0 == rv); c++) {
+            if (tile->pairs[c].value >= EPSILON)
+                nb_stored++;
+            if (NULL != shard)
+                rv = shard_write_pair(shard, tile->pairs[c].value, tile->pairs[c].word_1, tile->pairs[c].word_2);
+            else
+                rv = store_pair(nnchain, sorter, similarity, queue, tile->pairs[c].value, tile->pairs[c].word_1, tile->pairs[c].word_2);
+        }
+        nb_pruned += tile->nb_pruned;
+        nb_filtered += tile->nb_filtered;
+        nb_below += tile->nb_below;
+        free(tile->pairs);
+        tile->pairs = NULL;
+        tiles_release(&scoring, t + 1, tile->max_pairs * sizeof(scored_pair_t));
+    }
+    /* After an error, the tiles left are not consumed: let them all run. */
+    tiles_release(&scoring, nb_tasks, 0);
+    if ((0 != scheduler_join(scheduler)) || (0 != rv)) {
+        fprintf(stderr, "error scoring pairs of words\n");
+        shard_close(shard);
+        return -1;
+    }
+    if (NULL != shards) {
+        /* Tile t was scored by shard t % N, as its (t / N)-th tile: the pairs come in the order of a single run. */
+        for (t = 0; (t < nb_tiles) && (0 == rv); t++) {
+            shard = shards[t % opts->merge_shards];
+            rv = shard_read_tile(shard, &counters);
+            if ((0 == rv) && (counters.tile != t)) {
+                fprintf(stderr, "shard %zu of %zu holds tile %zu instead of %zu\n", t % opts->merge_shards, opts->merge_shards,
+                        counters.tile, t);
+                rv = -1;
+            }
+            for (c = 0; (0 == rv) && (c < counters.nb_pairs); c++) {
+                if (0 != (rv = shard_read_pair(shard, &value, &word_1, &word_2)))
+                    break;
+                if (value >= EPSILON)
+                    nb_stored++;
+                rv = store_pair(nnchain, sorter, similarity, queue, value, word_1, word_2);
+            }
+            nb_pruned += counters.nb_pruned;
+            nb_filtered += counters.nb_filtered;
+            nb_below += counters.nb_below;
+        }
+        for (i = 0; i < opts->merge_shards; i++)
+            shard_close(shards[i]);
+        free(shards);
+        shard = NULL;
+        if (0 != rv) {
+            fprintf(stderr, "error merging the shards in %s\n", opts->shard_dir);
+            return -1;
+        }
+    }
+    if (NULL != knn) {
+        /* Only the edges of the graph, in (word_1, word_2) order like the tiles. */
+        if (NULL == (edges = knn_edges(knn, &nb_edges))) {
+            fprintf(stderr, "error calling knn_edges\n");
+            return -1;
+        }
+        for (c = 0; (c < nb_edges) && (0 == rv); c++) {
+            if (edges[c].value >= EPSILON)
+                nb_stored++;
+            rv = store_pair(nnchain, sorter, similarity, queue, edges[c].value, edges[c].word_1, edges[c].word_2);
+        }
+        free(edges);
+        knn_destroy(knn);
+        if (0 != rv)
+            return -1;
+        fprintf(stderr, "%zu neighbor edges\n", nb_edges);
+        /* Pruned and below are counted from both words of a pair. */
+        nb_pairs *= 2;
+    }
+    if ((NULL != sorter) && (0 != pairsort_merge(sorter))) {
+        fprintf(stderr, "error merging the runs of pairs\n");
+        return -1;
+    }
+    for (t = 0; t < nb_threads; t++) {
+        free(scoring.scorers[t].candidates);
+        free(scoring.scorers[t].scores);
+        qgram_search_destroy(scoring.scorers[t].search);
+        bktree_search_destroy(scoring.scorers[t].tree_search);
+    }
+    free(scoring.scorers);
+    free(scoring.tiles);
+    pthread_mutex_destroy(&scoring.mutex);
+    pthread_cond_destroy(&scoring.released);
+    qgram_index_destroy(index);
+    bktree_destroy(tree);
+    fprintf(stderr, "%zu pairs, %zu pruned by length, %zu filtered by index, %zu below cutoff, %zu stored\n", nb_pairs, nb_pruned,
+            nb_filtered, nb_below, nb_stored);
+    stats->nb_pairs = nb_pairs;
+    stats->nb_pruned = nb_pruned;
+    stats->nb_filtered = nb_filtered;
+    stats->nb_below = nb_below;
+    stats->nb_stored = nb_stored;
+    /* Every pair is queued before the first one is extracted. */
+    stats->queue_max = (NULL != queue) ? bucket_queue_size(queue) : 0;
+    stats->nb_runs = (NULL != sorter) ? pairsort_nb_runs(sorter) : 0;
+    if (NULL != lsh) {
+        stats->lsh_candidates = lsh_nb_candidates(lsh);
+        lsh_recall(lsh, opts->cutoff, LSH_RECALL_WORDS, &stats->lsh_similar, &stats->lsh_found);
+        fprintf(stderr, "recall %.3f: %zu of the %zu pairs of %d sampled words reaching the cutoff are candidates\n",
+                (0 == stats->lsh_similar) ? 1.0 : (double) stats->lsh_found / (double) stats->lsh_similar, stats->lsh_found,
+                stats->lsh_similar, LSH_RECALL_WORDS);
+        lsh_destroy(lsh);
+    }
+    if (NULL != shard) {
+        if (0 != shard_commit(shard)) {
+            fprintf(stderr, "error writing shard %zu of %zu in %s\n", opts->shard, opts->nb_shards, opts->shard_dir);
+            return -1;
+        }
+        fprintf(stderr, "shard %zu of %zu: %zu tiles written in %s\n", opts->shard, opts->nb_shards, nb_tasks, opts->shard_dir);
+        pass_done("third", stats);
+        free(word_ptrs);
+        free(word_lens);
+        free(words);
+        free(arena);
+        if (NULL != mw)
+            mmap_wrapper_delete(mw);
+        return 0;
+    }
+    pass_done("third", stats);
+
+    if (NULL != nnchain) {
+        fprintf(stderr, "fourth pass\n");
+        printer.words = words;
+        printer.nb_clusters = 0;
+        printer.stats = stats;
+        if ((0 != nnchain_run(nnchain)) || (0 != nnchain_clusters(nnchain, print_cluster, &printer))) {
+            fprintf(stderr, "error clustering with the nearest-neighbor chain\n");
+            return -1;
         }
+        /* Each merge makes one cluster out of two. */
+        stats->nb_merged = nb_words - printer.nb_clusters;
+        pass_done("fourth", stats);
+        nnchain_destroy(nnchain);
+        free(word_ptrs);
+        free(word_lens);
+        free(words);
+        free(arena);
+        if (NULL != mw)
+            mmap_wrapper_delete(mw);
+        return 0;
     }
 
     /* Start clustering */
-    clusters = list_make();
+    clusters.first = clusters.last = NULL;
+    sets = union_find_make(nb_words);
+    rejections = simstore_make(0.0);
+    cluster_pool = pool_make(sizeof(struct cluster_t), POOL_SLAB);
+    cells = list_pool_make(POOL_SLAB);
+    if ((NULL == sets) || (NULL == rejections) || (NULL == cluster_pool) || (NULL == cells)) {
+        fprintf(stderr, "error allocating the clusters\n");
+        return -1;
+    }
+    nb_merged = nb_scanned = nb_cached = 0;
     fprintf(stderr, "fourth pass\n");
-    for (d = heap_extract(heap); d != NULL; d = heap_extract(heap)) {
-        if (NULL == words[d->word_1].cluster) {
-            if (NULL == words[d->word_2].cluster) {
+    for (d = &distance; 1 == (rv = next_pair(queue, sorter, &(d->value), &word_1, &word_2));) {
+        d->word_1 = word_1;
+        d->word_2 = word_2;
+        cluster_1 = word_cluster(words, sets, d->word_1);
+        cluster_2 = word_cluster(words, sets, d->word_2);
+        if (NULL == cluster_1) {
+            if (NULL == cluster_2) {
                 /* fprintf(stderr, "%f [%.*s] [%.*s]\n", d->value, (int) words[d->word_1].word_len, words[d->word_1].word, */
                 /*                                        (int) words[d->word_2].word_len, words[d->word_2].word); */
-                cluster = malloc(sizeof(struct cluster_t));
-                cluster->words = list_make();
+                if (NULL == (cluster = pool_alloc(cluster_pool))) {
+                    fprintf(stderr, "error allocating a cluster\n");
+                    return -1;
+                }
+                memset(cluster, 0, sizeof(struct cluster_t));
+                if (NULL == (cluster->words = list_make_with_pool(cells))) {
+                    fprintf(stderr, "error allocating a cluster\n");
+                    return -1;
+                }
+                cluster->key = d->word_1;
                 list_enqueue_elt(cluster->words, &(words[d->word_1]));
                 list_enqueue_elt(cluster->words, &(words[d->word_2]));
-                words[d->word_1].cluster = cluster;
-                words[d->word_2].cluster = cluster;
-                list_enqueue_elt(clusters, cluster);
+                clusters_append(&clusters, cluster);
             } else {
                 /* fprintf(stderr, "%f [%.*s] in [%.*s]\n", d->value, (int) words[d->word_1].word_len, words[d->word_1].word, */
                 /*                                        (int) words[d->word_2].word_len, words[d->word_2].word); */
-                list_enqueue_elt(words[d->word_2].cluster->words, &(words[d->word_1]));
-                words[d->word_1].cluster = words[d->word_2].cluster;
+                cluster = cluster_2;
+                list_enqueue_elt(cluster->words, &(words[d->word_1]));
             }
-        } else if (NULL == words[d->word_2].cluster) {
+        } else if (NULL == cluster_2) {
             /* fprintf(stderr, "%f [%.*s] in [%.*s]\n", d->value, (int) words[d->word_2].word_len, words[d->word_2].word, */
             /*                                        (int) words[d->word_1].word_len, words[d->word_1].word); */
-            list_enqueue_elt(words[d->word_1].cluster->words, &(words[d->word_2]));
-            words[d->word_2].cluster = words[d->word_1].cluster;
-        } else if ((words[d->word_1].cluster != words[d->word_2].cluster) && (d->value > EPSILON)) {
+            cluster = cluster_1;
+            list_enqueue_elt(cluster->words, &(words[d->word_2]));
+        } else if ((cluster_1 != cluster_2) && (d->value > EPSILON)) {
             /*
              * Compare each word of cluster 1 to each word of cluster 2, if the
              * maximum measured similarity is smaller than EPSILON do not merge them.
              */
             cell_t *cellword1, *cellword2;
-            float max_dist;
+            size_t nb_cells;
+            float min_sim;
             int mismatch;
 
             /* fprintf(stderr, "%f clustered [%.*s] [%.*s]\n", d->value, (int) words[d->word_1].word_len, words[d->word_1].word, */
             /*                                        (int) words[d->word_2].word_len, words[d->word_2].word); */
-            max_dist = 0.0;
+            if (SIMSTORE_BELOW != simstore_get(rejections, cluster_1->key, cluster_2->key)) {
+                nb_cached++;
+                continue;
+            }
+            nb_scanned++;
+            min_sim = 1.0;
             mismatch = 0;
-            for (cellword1 = list_first(words[d->word_1].cluster->words);
+            nb_cells = 0;
+            for (cellword1 = list_first(cluster_1->words);
                  (cellword1 != NULL) && (mismatch == 0);
                  cellword1 = list_next(cellword1)) {
                 word_t *word1;
                 word1 = list_get(cellword1);
-                for (cellword2 = list_first(words[d->word_2].cluster->words);
+                for (cellword2 = list_first(cluster_2->words);
                      (cellword2 != NULL) && (mismatch == 0);
                      cellword2 = list_next(cellword2)) {
                     word_t *word2;
 
                     word2 = list_get(cellword2);
-                    if (similarity[word1->idx + word2->idx * nb_words] < EPSILON) {
+                    nb_cells++;
+                    if ((min_sim = pair_similarity(similarity, opts, word1, word2)) < EPSILON) {
                         mismatch = 1;
-                        /* fprintf(stderr, "%f mismatch cluster [%.*s](%zi)(%p) [%.*s](%zi)(%p)\n", */
-                                /* similarity[word1->idx + word2->idx * nb_words], */
-                                /* (int) word1->word_len, word1->word, word1->idx, word1->cluster, */
-                                /* (int) word2->word_len, word2->word, word2->idx, word2->cluster); */
+                        /* fprintf(stderr, "%f mismatch cluster [%.*s](%zi) [%.*s](%zi)\n", */
+                                /* simstore_get(similarity, word1->idx, word2->idx), */
+                                /* (int) word1->word_len, word1->word, word1->idx, */
+                                /* (int) word2->word_len, word2->word, word2->idx); */
                     }
                 }
             }
-            if (mismatch == 0) {
-                /* Merge */
-                cluster_t *tmpcluster;
-
-                tmpcluster = words[d->word_2].cluster;
-                for (cellword2 = list_first(words[d->word_2].cluster->words);
-                        (cellword2 != NULL) && (mismatch == 0);
-                        cellword2 = list_next(cellword2)) {
-                    word_t *word2;
-
-                    word2 = list_get(cellword2);
-                    word2->cluster = words[d->word_1].cluster;
-                    list_enqueue_elt(words[d->word_1].cluster->words, word2);
-                    /* fprintf(stderr, "merge [%.*s] in [%.*s]\n", (int) word2->word_len, word2->word, */
-                    /*                                                   (int) words[d->word_1].word_len, words[d->word_1].word); */
+            if (mismatch != 0) {
+                stats_rejection(stats, nb_cells);
+                if ((0 != simstore_set(rejections, cluster_1->key, cluster_2->key, (min_sim > 0.0) ? min_sim : 0.0))
+                    || (0 != cluster_reject(cluster_1, cluster_2->key)) || (0 != cluster_reject(cluster_2, cluster_1->key))) {
+                    fprintf(stderr, "error caching a cluster rejection\n");
+                    return -1;
                 }
-                list_remove(clusters, tmpcluster);
-                list_delete(tmpcluster->words);
-                free(tmpcluster);
+                continue;
+            }
+            /* Merge: the words of cluster 2 follow those of cluster 1. */
+            if (0 != cluster_merge_rejections(words, sets, rejections, cluster_1, cluster_2)) {
+                fprintf(stderr, "error merging cluster rejections\n");
+                return -1;
             }
+            nb_merged++;
+            stats->cells_merged += nb_cells;
+            list_enqueue(cluster_1->words, cluster_2->words);
+            list_release_container(cluster_2->words);
+            clusters_unlink(&clusters, cluster_2);
+            pool_free(cluster_pool, cluster_2);
+            cluster = cluster_1;
+        } else {
+            continue;
         }
+        words[union_find_union(sets, d->word_1, d->word_2)].cluster = cluster;
     }
+    if (0 != rv) {
+        fprintf(stderr, "error reading the sorted pairs\n");
+        return -1;
+    }
+    fprintf(stderr, "%zu clusters merged, %zu merges checked, %zu rejected from cache\n", nb_merged, nb_scanned, nb_cached);
+    stats->nb_merged = nb_merged;
+    stats->nb_cached = nb_cached;
+    pass_done("fourth", stats);
 
     /* List clusters */
-    for (i = 0, cell = list_first(clusters); cell != NULL; cell = list_next(cell), i++) {
+    for (i = 0, cluster = clusters.first; cluster != NULL; cluster = cluster->next, i++) {
         cell_t *word_cell;
-        cluster = list_get(cell);
         fprintf(stdout, "Cluster %zi: ", i);
-        for (word_cell = list_first(cluster->words); word_cell != NULL; word_cell = list_next(word_cell)) {
+        for (j = 0, word_cell = list_first(cluster->words); word_cell != NULL; word_cell = list_next(word_cell), j++) {
             word_t *word;
             word = list_get(word_cell);
-            fprintf(stdout, "[%.*s] ", (int) word->word_len, word->word);
+            print_word(word);
         }
         fprintf(stdout, "\n");
+        stats_cluster(stats, j);
+    }
+    /* Words without any pair above the cutoff are clusters of their own. */
+    for (j = 0; j < nb_words; j++) {
+        if (NULL == word_cluster(words, sets, j)) {
+            fprintf(stdout, "Cluster %zi: ", i++);
+            print_word(words + j);
+            fprintf(stdout, "\n");
+            stats_cluster(stats, 1);
+        }
+    }
+    /* The cells and the clusters themselves go with their pools. */
+    for (cluster = clusters.first; cluster != NULL; cluster = cluster->next) {
+        list_release_container(cluster->words);
+        free(cluster->rejected);
     }
+    pool_destroy(cells);
+    pool_destroy(cluster_pool);
+    union_find_destroy(sets);
+    simstore_destroy(rejections);
+    pairsort_destroy(sorter);
+    free(word_ptrs);
+    free(word_lens);
+    free(words);
+    free(arena);
+    if (NULL != mw)
+        mmap_wrapper_delete(mw);
+
+    return 0;
+}
+
+/*
+ * Streaming mode: words are read from stdin as they come, and the cluster of
+ * each one is printed (and flushed) at once, with the same format as the
+ * batch output, a cluster number showing up once per word it receives.
+ */
+static inline int process_stream(const options_t *opts)
+{
+    stream_t *stream;
+    char *line = NULL, *word;
+    size_t line_size = 0, len, cluster, nb_words = 0;
+    ssize_t line_len;
+    int rv = 0;
+
+    stream = stream_make((opts->cutoff > EPSILON) ? opts->cutoff : EPSILON);
+    if (NULL == stream) {
+        fprintf(stderr, "error calling stream_make\n");
+        return -1;
+    }
+    while ((0 == rv) && (-1 != (line_len = getline(&line, &line_size, stdin)))) {
+        for (word = line; (0 == rv) && (word < line + line_len); word += len + 1) {
+            len = strcspn(word, "\r\n\t");
+            if (len <= IGNORE_SIZE)
+                continue;
+            if (0 != stream_assign(stream, word, len, &cluster)) {
+                fprintf(stderr, "error calling stream_assign\n");
+                rv = -1;
+                break;
+            }
+            fprintf(stdout, "Cluster %zi: [%.*s] \n", cluster, (int) len, word);
+            fflush(stdout);
+            nb_words++;
+        }
+    }
+    if (ferror(stdin)) {
+        perror("getline");
+        rv = -1;
+    }
+    fprintf(stderr, "%zu words, %zu clusters\n", nb_words, stream_nb_clusters(stream));
+    free(line);
+    stream_destroy(stream);
+
+    return rv;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t cutoff] [-q length [-p] | -b | -k count] [-j threads] [-e engine] file\n", name);
+    fprintf(stderr, "       %s [-t cutoff] [-q length [-p] | -b | --lsh BxR] [-j threads] --shard i/N [--shard-dir dir] file\n", name);
+    fprintf(stderr, "       %s [-t cutoff] [-q length [-p] | -b | --lsh BxR] [-e engine] --merge-shards N [--shard-dir dir] file\n", name);
+    fprintf(stderr, "       %s -s [-t cutoff]\n", name);
+    fprintf(stderr, "  -t cutoff  minimum similarity (0 to 1) of a pair to be clustered, default 0: every pair\n");
+    fprintf(stderr, "  -q length  only compare words sharing enough q-grams of that length (1 to %d) to reach the cutoff\n", QGRAM_MAX_Q);
+    fprintf(stderr, "  -p         with -q, only count q-grams at compatible positions\n");
+    fprintf(stderr, "  -b         only compare words found within reach of the cutoff in a BK-tree\n");
+    fprintf(stderr, "  -k count   only cluster the pairs of a word and one of its count most similar words\n");
+    fprintf(stderr, "  -j threads number of threads scoring pairs, default 1\n");
+    fprintf(stderr, "  --lsh BxR  approximate: only compare words sharing one of B bands of R MinHash rows of their %d-shingles\n",
+            LSH_SHINGLE);
+    fprintf(stderr, "  -e engine  clustering engine: greedy (default), merging pairs most similar first, or nnchain,\n");
+    fprintf(stderr, "             complete linkage of the pairs above %.2f, without a queue of pairs\n", EPSILON);
+    fprintf(stderr, "  -s         read words from stdin, printing the cluster of each one as it comes\n");
+    fprintf(stderr, "  --stats file\n");
+    fprintf(stderr, "             write the counters and timings of the run to file, as JSON\n");
+    fprintf(stderr, "  --mem-limit size\n");
+    fprintf(stderr, "             sort the pairs out of core in that much memory (k, M or G suffix), instead of a queue,\n");
+    fprintf(stderr, "             half of it for the pairs scored ahead of the sort\n");
+    fprintf(stderr, "  --scratch-dir dir\n");
+    fprintf(stderr, "             directory of the --mem-limit scratch files, default $TMPDIR or /tmp\n");
+    fprintf(stderr, "  --shard i/N\n");
+    fprintf(stderr, "             only score shard i (0 to N - 1) of the pairs, into the file shard-i-of-N.pairs,\n");
+    fprintf(stderr, "             which only appears once complete\n");
+    fprintf(stderr, "  --merge-shards N\n");
+    fprintf(stderr, "             cluster the pairs of the N shards of the same file, cutoff and filter, instead of scoring them\n");
+    fprintf(stderr, "  --shard-dir dir\n");
+    fprintf(stderr, "             directory of the shard files, default the current one\n");
+}
+
+/* Long options, without a short form. */
+#define OPT_STATS 256
+#define OPT_MEM_LIMIT 257
+#define OPT_SCRATCH_DIR 258
+#define OPT_LSH 259
+#define OPT_SHARD 260
+#define OPT_MERGE_SHARDS 261
+#define OPT_SHARD_DIR 262
+
+static const struct option long_options[] = {
+    { "stats", required_argument, NULL, OPT_STATS },
+    { "mem-limit", required_argument, NULL, OPT_MEM_LIMIT },
+    { "scratch-dir", required_argument, NULL, OPT_SCRATCH_DIR },
+    { "lsh", required_argument, NULL, OPT_LSH },
+    { "shard", required_argument, NULL, OPT_SHARD },
+    { "merge-shards", required_argument, NULL, OPT_MERGE_SHARDS },
+    { "shard-dir", required_argument, NULL, OPT_SHARD_DIR },
+    { NULL, 0, NULL, 0 }
+};
+
+/* A size in bytes, with an optional k, M or G suffix. */
+static int parse_size(const char *arg, size_t *size)
+{
+    unsigned long long value;
+    char *end;
+
+    value = strtoull(arg, &end, 10);
+    if (end == arg)
+        return -1;
+    switch (*end) {
+    case 'k': case 'K':
+        value <<= 10;
+        end++;
+        break;
+    case 'm': case 'M':
+        value <<= 20;
+        end++;
+        break;
+    case 'g': case 'G':
+        value <<= 30;
+        end++;
+        break;
+    }
+    if ('\0' != *end)
+        return -1;
+    *size = (size_t) value;
 
     return 0;
 }
 
 int main(int argc, char **argv)
 {
-    int rv;
+    options_t opts;
+    stats_t stats;
+    struct rusage rusage;
+    char *end;
+    int rv, opt;
+
+    memset(&opts, 0, sizeof(opts));
+    while (-1 != (opt = getopt_long(argc, argv, "t:q:pbk:j:e:s", long_options, NULL))) {
+        switch (opt) {
+        case 't':
+            opts.cutoff = strtof(optarg, &end);
+            if ((end == optarg) || ('\0' != *end) || (opts.cutoff < 0.0) || (opts.cutoff > 1.0)) {
+                fprintf(stderr, "invalid cutoff %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'q':
+            opts.qgram = strtoul(optarg, &end, 10);
+            if ((end == optarg) || ('\0' != *end) || (opts.qgram < 1) || (opts.qgram > QGRAM_MAX_Q)) {
+                fprintf(stderr, "invalid q-gram length %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'p':
+            opts.positional = 1;
+            break;
+        case 'b':
+            opts.bktree = 1;
+            break;
+        case 'k':
+            opts.neighbors = strtoul(optarg, &end, 10);
+            if ((end == optarg) || ('\0' != *end) || (opts.neighbors < 1)) {
+                fprintf(stderr, "invalid number of neighbors %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'j':
+            opts.threads = strtoul(optarg, &end, 10);
+            if ((end == optarg) || ('\0' != *end) || (opts.threads < 1)) {
+                fprintf(stderr, "invalid number of threads %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 's':
+            opts.stream = 1;
+            break;
+        case 'e':
+            if (0 == strcmp(optarg, "greedy")) {
+                opts.engine = ENGINE_GREEDY;
+            }
+            else if (0 == strcmp(optarg, "nnchain")) {
+                opts.engine = ENGINE_NNCHAIN;
+            }
+            else {
+                fprintf(stderr, "invalid engine %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_STATS:
+            opts.stats = optarg;
+            break;
+        case OPT_MEM_LIMIT:
+            if ((0 != parse_size(optarg, &opts.mem_limit)) || (opts.mem_limit < 2 * PAIRSORT_MIN_MEMORY)) {
+                fprintf(stderr, "invalid memory limit %s (%d bytes at least)\n", optarg, 2 * PAIRSORT_MIN_MEMORY);
+                return -1;
+            }
+            break;
+        case OPT_SCRATCH_DIR:
+            opts.scratch_dir = optarg;
+            break;
+        case OPT_LSH:
+            if ((2 != sscanf(optarg, "%zux%zu", &opts.bands, &opts.rows)) || (0 == opts.bands) || (0 == opts.rows)
+                || (opts.bands * opts.rows > LSH_MAX_HASHES)) {
+                fprintf(stderr, "invalid bands and rows %s (BxR, at most %d hashes)\n", optarg, LSH_MAX_HASHES);
+                return -1;
+            }
+            break;
+        case OPT_SHARD:
+            if ((2 != sscanf(optarg, "%zu/%zu", &opts.shard, &opts.nb_shards)) || (opts.shard >= opts.nb_shards)) {
+                fprintf(stderr, "invalid shard %s (i/N, i from 0 to N - 1)\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_MERGE_SHARDS:
+            opts.merge_shards = strtoul(optarg, &end, 10);
+            if ((end == optarg) || ('\0' != *end) || (opts.merge_shards < 1)) {
+                fprintf(stderr, "invalid number of shards %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_SHARD_DIR:
+            opts.shard_dir = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
 
-    if (argc < 2) {
+    if (opts.stream) {
+        if (NULL != opts.stats) {
+            fprintf(stderr, "--stats excludes -s\n");
+            return -1;
+        }
+        if (0 != process_stream(&opts)) {
+            fprintf(stderr, "error calling process_stream\n");
+            return -1;
+        }
+        return 0;
+    }
+    if (optind >= argc) {
         fprintf(stderr, "%s requires one parameter, which is input filename.\n", argv[0]);
+        usage(argv[0]);
+        return -1;
+    }
+    if ((0 != opts.qgram) && (opts.cutoff <= 0.0)) {
+        fprintf(stderr, "-q requires a cutoff (-t), every pair is a candidate otherwise\n");
+        return -1;
+    }
+    if (opts.bktree && ((0 != opts.qgram) || (opts.cutoff <= 0.0))) {
+        fprintf(stderr, "-b requires a cutoff (-t) and excludes -q\n");
+        return -1;
+    }
+    if ((0 != opts.neighbors) && (opts.bktree || (0 != opts.qgram) || (0 != opts.mem_limit))) {
+        fprintf(stderr, "-k excludes -q, -b and --mem-limit\n");
         return -1;
     }
+    if ((0 != opts.bands)
+        && ((opts.cutoff <= 0.0) || opts.bktree || (0 != opts.qgram) || (0 != opts.neighbors) || (0 != opts.mem_limit))) {
+        fprintf(stderr, "--lsh requires a cutoff (-t) and excludes -q, -b, -k and --mem-limit\n");
+        return -1;
+    }
+    if ((0 != opts.nb_shards) || (0 != opts.merge_shards)) {
+        if (0 != opts.neighbors) {
+            fprintf(stderr, "--shard and --merge-shards exclude -k, whose edges need every row of the graph\n");
+            return -1;
+        }
+        if ((0 != opts.nb_shards) && ((0 != opts.merge_shards) || (0 != opts.mem_limit))) {
+            fprintf(stderr, "--shard excludes --merge-shards and --mem-limit, which cluster the pairs of the shards\n");
+            return -1;
+        }
+    }
+    if ((0 != opts.mem_limit) && (ENGINE_NNCHAIN == opts.engine)) {
+        fprintf(stderr, "--mem-limit only applies to the greedy engine, nnchain has no queue of pairs\n");
+        return -1;
+    }
+    if (NULL == opts.shard_dir)
+        opts.shard_dir = ".";
+    if (NULL == opts.scratch_dir)
+        opts.scratch_dir = (NULL != getenv("TMPDIR")) ? getenv("TMPDIR") : "/tmp";
 
-    rv = process_file(argv[1]);
+    stats_init(&stats);
+    rv = process_file(argv[optind], &opts, &stats);
     if (0 != rv) {
         fprintf(stderr, "error calling process_file\n");
         return -1;
     }
+    if (0 == getrusage(RUSAGE_SELF, &rusage))
+        fprintf(stderr, "peak RSS: %ld kB\n", rusage.ru_maxrss);
+    if ((NULL != opts.stats) && (0 != stats_write(&stats, opts.stats))) {
+        fprintf(stderr, "error writing the statistics to %s\n", opts.stats);
+        return -1;
+    }
 
     return 0;
 }
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "knn.h"
+#include "levenshtein.h"
+
+struct knn_neighbor_t {
+    float value;
+    uint32_t word;
+};
+
+/*
+ * Row i holds the neighbors of word i, a min-heap of at most k neighbors: the
+ * root is the worst one kept, whose similarity is the bound a new neighbor
+ * must reach.
+ */
+struct knn_t {
+    const char * const *words;
+    const size_t *lens;
+    size_t nb_words, k;
+    float cutoff;
+    struct knn_neighbor_t *rows;
+    size_t *nb_neighbors;
+};
+
+/* Worse neighbor: less similar, or as similar and found later. */
+static inline int knn_worse(const struct knn_neighbor_t *n1, const struct knn_neighbor_t *n2)
+{
+    return (n1->value < n2->value) || ((n1->value == n2->value) && (n1->word > n2->word));
+}
+
+static void knn_sift_down(struct knn_neighbor_t *row, size_t nb, size_t pos)
+{
+    struct knn_neighbor_t swap;
+    size_t child;
+
+    for (child = 2 * pos + 1; child < nb; pos = child, child = 2 * pos + 1) {
+        if ((child + 1 < nb) && knn_worse(row + child + 1, row + child))
+            child++;
+        if (!knn_worse(row + child, row + pos))
+            break;
+        swap = row[pos];
+        row[pos] = row[child];
+        row[child] = swap;
+    }
+}
+
+static void knn_sift_up(struct knn_neighbor_t *row, size_t pos)
+{
+    struct knn_neighbor_t swap;
+    size_t parent;
+
+    for (; pos > 0; pos = parent) {
+        parent = (pos - 1) / 2;
+        if (!knn_worse(row + pos, row + parent))
+            break;
+        swap = row[pos];
+        row[pos] = row[parent];
+        row[parent] = swap;
+    }
+}
+
+/* Words from the returned one to i - 1 are long enough to reach the cutoff with word i. */
+static size_t knn_window_start(const knn_t *knn, size_t i)
+{
+    size_t lo, hi, mid;
+
+    for (lo = 0, hi = i; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+        if ((float) knn->lens[mid] / (float) knn->lens[i] >= knn->cutoff)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return lo;
+}
+
+/* Words from i + 1 to the returned one - 1 are short enough to reach the cutoff with word i. */
+static size_t knn_window_end(const knn_t *knn, size_t i)
+{
+    size_t lo, hi, mid;
+
+    for (lo = i + 1, hi = knn->nb_words; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+        if ((float) knn->lens[i] / (float) knn->lens[mid] >= knn->cutoff)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+knn_t *knn_make(const char * const *words, const size_t *lens, size_t nb_words, size_t k, float cutoff)
+{
+    knn_t *knn;
+
+    if (NULL == (knn = calloc(1, sizeof(knn_t))))
+        return NULL;
+    knn->words = words;
+    knn->lens = lens;
+    knn->nb_words = nb_words;
+    knn->k = k;
+    knn->cutoff = cutoff;
+    knn->rows = malloc((nb_words * k + 1) * sizeof(struct knn_neighbor_t));
+    knn->nb_neighbors = calloc(nb_words + 1, sizeof(size_t));
+    if ((NULL == knn->rows) || (NULL == knn->nb_neighbors)) {
+        knn_destroy(knn);
+        return NULL;
+    }
+
+    return knn;
+}
+
+void knn_destroy(knn_t *knn)
+{
+    if (NULL != knn) {
+        free(knn->rows);
+        free(knn->nb_neighbors);
+        free(knn);
+    }
+}
+
+void knn_build(knn_t *knn, size_t first, size_t last, size_t *nb_pruned, size_t *nb_below)
+{
+    struct knn_neighbor_t *row, candidate;
+    size_t i, j, lo, hi, nb;
+    float bound;
+
+    *nb_pruned = *nb_below = 0;
+    for (i = first; i < last; i++) {
+        row = knn->rows + i * knn->k;
+        lo = knn_window_start(knn, i);
+        hi = knn_window_end(knn, i);
+        *nb_pruned += knn->nb_words - (hi - lo);
+        for (j = lo, nb = 0; j < hi; j++) {
+            if (j == i)
+                continue;
+            /* Once the row is full, only a pair as similar as its worst neighbor matters. */
+            bound = ((nb == knn->k) && (row[0].value > knn->cutoff)) ? row[0].value : knn->cutoff;
+            if (bound > 0.0) {
+                candidate.value = (i < j)
+                    ? levenshtein_norm_distance_bounded(knn->words[i], knn->lens[i], knn->words[j], knn->lens[j], bound)
+                    : levenshtein_norm_distance_bounded(knn->words[j], knn->lens[j], knn->words[i], knn->lens[i], bound);
+            }
+            else {
+                candidate.value = (i < j)
+                    ? levenshtein_norm_distance(knn->words[i], knn->lens[i], knn->words[j], knn->lens[j])
+                    : levenshtein_norm_distance(knn->words[j], knn->lens[j], knn->words[i], knn->lens[i]);
+            }
+            candidate.word = (uint32_t) j;
+            if ((candidate.value == LEVENSHTEIN_BELOW) || ((nb == knn->k) && !knn_worse(row, &candidate))) {
+                (*nb_below)++;
+                continue;
+            }
+            if (nb < knn->k) {
+                row[nb] = candidate;
+                knn_sift_up(row, nb++);
+            }
+            else {
+                row[0] = candidate;
+                knn_sift_down(row, nb, 0);
+            }
+        }
+        knn->nb_neighbors[i] = nb;
+    }
+}
+
+static int knn_edge_cmp(const void *data1, const void *data2)
+{
+    const knn_edge_t *e1 = data1;
+    const knn_edge_t *e2 = data2;
+
+    if (e1->word_1 != e2->word_1)
+        return (e1->word_1 < e2->word_1) ? -1 : 1;
+
+    return (e1->word_2 < e2->word_2) ? -1 : ((e1->word_2 > e2->word_2) ? 1 : 0);
+}
+
+knn_edge_t *knn_edges(const knn_t *knn, size_t *nb_edges)
+{
+    const struct knn_neighbor_t *row;
+    knn_edge_t *edges;
+    size_t i, n, e, kept;
+
+    if (NULL == (edges = malloc((knn->nb_words * knn->k + 1) * sizeof(knn_edge_t)))) {
+        perror("malloc");
+        return NULL;
+    }
+    for (i = 0, e = 0; i < knn->nb_words; i++) {
+        for (n = 0, row = knn->rows + i * knn->k; n < knn->nb_neighbors[i]; n++, e++) {
+            edges[e].word_1 = (uint32_t) ((i < row[n].word) ? i : row[n].word);
+            edges[e].word_2 = (uint32_t) ((i < row[n].word) ? row[n].word : i);
+            edges[e].value = row[n].value;
+        }
+    }
+    /* Pairs where each word is a neighbor of the other come twice. */
+    qsort(edges, e, sizeof(knn_edge_t), knn_edge_cmp);
+    for (i = 0, kept = 0; i < e; i++) {
+        if ((0 == kept) || (0 != knn_edge_cmp(edges + kept - 1, edges + i)))
+            edges[kept++] = edges[i];
+    }
+    *nb_edges = kept;
+
+    return edges;
+}
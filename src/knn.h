@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef KNN_H
+#define KNN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct knn_t knn_t;
+
+/* An edge of the graph, word_1 < word_2. */
+struct knn_edge_t {
+    uint32_t word_1, word_2;
+    float value;
+};
+typedef struct knn_edge_t knn_edge_t;
+
+/**
+ * Make a new graph of the k most similar words of each word (normalized
+ * Levenshtein similarity, at least the cutoff): n rows of k neighbors, built
+ * by knn_build.
+ * @param words The words, sorted by increasing length, which must outlive the
+ * graph.
+ * @param lens The length of each word.
+ * @param nb_words The number of words (smaller than 2^32).
+ * @param k The number of neighbors of a word.
+ * @param cutoff The minimum similarity of a neighbor.
+ * @return Return a pointer to a newly allocated graph, NULL if an error
+ * occured.
+ */
+knn_t *knn_make(const char * const *words, const size_t *lens, size_t nb_words, size_t k, float cutoff);
+
+/**
+ * Deallocate the graph.
+ * @param knn The graph you are working with.
+ */
+void knn_destroy(knn_t *knn);
+
+/**
+ * Find the neighbors of words first to last - 1, among the words whose length
+ * may reach the cutoff. Among neighbors of equal similarity the first words
+ * are kept.
+ * @param knn The graph you are working with.
+ * @param first The first word.
+ * @param last The word after the last one.
+ * @param nb_pruned Receives the number of words skipped for their length.
+ * @param nb_below Receives the number of words compared, but not similar
+ * enough to be neighbors when compared.
+ * @remark Threads may build distinct ranges of words at the same time.
+ */
+void knn_build(knn_t *knn, size_t first, size_t last, size_t *nb_pruned, size_t *nb_below);
+
+/**
+ * Get the edges of the graph: a pair of words is an edge when one of them is
+ * a neighbor of the other.
+ * @param knn The graph you are working with, built for every word.
+ * @param nb_edges Receives the number of edges.
+ * @return A newly allocated array of the edges, sorted by increasing
+ * (word_1, word_2), NULL if an error occured.
+ */
+knn_edge_t *knn_edges(const knn_t *knn, size_t *nb_edges);
+
+#endif /* KNN_H */
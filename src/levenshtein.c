@@ -1,72 +1,324 @@
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "levenshtein.h"
 
+/*
+ * Case folding used by every kernel, equivalent to tolower() in the "C"
+ * locale but without the function call and safe for signed chars.
+ */
+#define LEV_FOLD(c) ((unsigned char) ((((unsigned char) (c)) >= 'A' && ((unsigned char) (c)) <= 'Z') ? ((c) | 0x20) : (c)))
+#define LEV_WORD_BITS 64
+#define LEV_LOW_MASK(i) (((i) >= LEV_WORD_BITS) ? ~((uint64_t) 0) : ((((uint64_t) 1) << (i)) - 1))
+#define LEV_TMPBUF_SIZE 4096
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
 #define MIN3(a,b,c) (((a)<(b))?(((a)<(c))?(a):(((b)<(c))?(b):(c))):(((b)<(c))?(b):(((a)<(c))?(a):(c))))
-static inline size_t levenshtein_distance_internal(const char *s1, size_t l1, const char *s2, size_t l2, size_t *zsize)
+
+/*
+ * Bit-parallel kernels (Myers 1999, Hyyro 2003).
+ * s1 is the "pattern": its characters are the rows of the DP matrix, packed
+ * as bits of one (or several) 64 bits words. s2 is the "text", processed one
+ * column at a time. After column j, bit i of vp (resp. vn) is set when
+ * D(i + 1, j) - D(i, j) is +1 (resp. -1), and bit i of hp (resp. hn) is set
+ * when D(i + 1, j) - D(i + 1, j - 1) is +1 (resp. -1).
+ * When the caller needs the alignment length, the four vectors of every
+ * column are kept in cols (LEV_COL_VECTORS * nb_blocks words per column), so
+ * the optimal alignment can be traced back with bit tests instead of the
+ * full size_t matrix.
+ */
+#define LEV_COL_VECTORS 4
+#define LEV_COL_VP 0
+#define LEV_COL_VN 1
+#define LEV_COL_HP 2
+#define LEV_COL_HN 3
+
+static inline void lev_build_peq(const char *s1, size_t l1, const char *s2, size_t l2, uint64_t *peq, size_t nb_blocks)
 {
-    size_t tmpbuf[1024], *dbuf;
-    size_t l1l2, l2_1, l1_1, cost, result;
-    int i, j, k;
+    size_t i, b;
 
-    l1_1 = l1 + 1;
-    l2_1 = l2 + 1;
-    l1l2 = (l1_1 * l2_1);
-    if (l1l2 > (sizeof(tmpbuf) / sizeof(size_t))) {
-        dbuf = malloc(l1l2 * sizeof(size_t));
-    }
-    else {
-        dbuf = tmpbuf;
+    /* Only touch entries that will be read: characters of s1 and s2. */
+    for (i = 0; i < l2; i++)
+        for (b = 0; b < nb_blocks; b++)
+            peq[LEV_FOLD(s2[i]) * nb_blocks + b] = 0;
+    for (i = 0; i < l1; i++)
+        for (b = 0; b < nb_blocks; b++)
+            peq[LEV_FOLD(s1[i]) * nb_blocks + b] = 0;
+    for (i = 0; i < l1; i++)
+        peq[LEV_FOLD(s1[i]) * nb_blocks + (i / LEV_WORD_BITS)] |= ((uint64_t) 1) << (i % LEV_WORD_BITS);
+}
+
+/* Distance of s1 (l1 <= 64) to s2, optionally keeping every column. */
+static inline size_t lev_myers_single(const char *s1, size_t l1, const char *s2, size_t l2, uint64_t *cols)
+{
+    uint64_t peq[256];
+    uint64_t vp, vn, eq, d0, hp, hn, last;
+    size_t j, score;
+
+    lev_build_peq(s1, l1, s2, l2, peq, 1);
+    vp = LEV_LOW_MASK(l1);
+    vn = 0;
+    last = ((uint64_t) 1) << (l1 - 1);
+    score = l1;
+
+    for (j = 0; j < l2; j++) {
+        eq = peq[LEV_FOLD(s2[j])];
+        d0 = (((eq & vp) + vp) ^ vp) | eq | vn;
+        hp = vn | ~(d0 | vp);
+        hn = d0 & vp;
+        if (hp & last)
+            score++;
+        else if (hn & last)
+            score--;
+        if (NULL != cols) {
+            cols[j * LEV_COL_VECTORS + LEV_COL_HP] = hp;
+            cols[j * LEV_COL_VECTORS + LEV_COL_HN] = hn;
+        }
+        /* Global distance: the row 0 always increases by one. */
+        hp = (hp << 1) | 1;
+        hn = hn << 1;
+        vp = hn | ~(d0 | hp);
+        vn = hp & d0;
+        if (NULL != cols) {
+            cols[j * LEV_COL_VECTORS + LEV_COL_VP] = vp;
+            cols[j * LEV_COL_VECTORS + LEV_COL_VN] = vn;
+        }
     }
-    memset(dbuf, 0, l1l2 * sizeof(size_t));
 
-    dbuf[0] = 0;
-    for (i = 1; i < l1_1; i++)
-        dbuf[l2_1 * i] = i;
+    return score;
+}
 
-    for (j = 1; j < l2_1; j++) {
-        dbuf[j] = j;
-        for (i = 1; i < l1_1; i++) {
-            size_t above, left, diag;
+/* Distance of s1 (any length) to s2, using ceil(l1 / 64) blocks per column. */
+static inline size_t lev_myers_block(const char *s1, size_t l1, const char *s2, size_t l2, uint64_t *peq, uint64_t *vp, uint64_t *vn,
+                                     uint64_t *cols)
+{
+    uint64_t eq, x, d0, hp, hn, hp_carry, hn_carry, last;
+    size_t b, j, nb_blocks, score;
 
-            if (tolower(s1[i - 1]) != tolower(s2[j - 1])) {
-                above = dbuf[l2_1 * (i - 1) + j] + 1;
-                left = dbuf[l2_1 * i + (j - 1)] + 1;
-                diag = dbuf[l2_1 * (i - 1) + (j - 1)] + 1;
-                dbuf[l2_1 * i + j] = MIN3(above, left, diag);
-            } else {
-                dbuf[l2_1 * i + j] = dbuf[l2_1 * (i - 1) + (j - 1)];
+    nb_blocks = (l1 + LEV_WORD_BITS - 1) / LEV_WORD_BITS;
+    lev_build_peq(s1, l1, s2, l2, peq, nb_blocks);
+    for (b = 0; b < nb_blocks; b++) {
+        vp[b] = ~((uint64_t) 0);
+        vn[b] = 0;
+    }
+    vp[nb_blocks - 1] = LEV_LOW_MASK(l1 - (nb_blocks - 1) * LEV_WORD_BITS);
+    last = ((uint64_t) 1) << ((l1 - 1) % LEV_WORD_BITS);
+    score = l1;
+
+    for (j = 0; j < l2; j++) {
+        uint64_t *col = (NULL != cols) ? cols + j * LEV_COL_VECTORS * nb_blocks : NULL;
+
+        hp_carry = 1;
+        hn_carry = 0;
+        for (b = 0; b < nb_blocks; b++) {
+            eq = peq[LEV_FOLD(s2[j]) * nb_blocks + b];
+            x = eq | hn_carry;
+            d0 = (((x & vp[b]) + vp[b]) ^ vp[b]) | x | vn[b];
+            hp = vn[b] | ~(d0 | vp[b]);
+            hn = d0 & vp[b];
+            if (b == nb_blocks - 1) {
+                if (hp & last)
+                    score++;
+                else if (hn & last)
+                    score--;
+            }
+            if (NULL != col) {
+                col[LEV_COL_HP * nb_blocks + b] = hp;
+                col[LEV_COL_HN * nb_blocks + b] = hn;
+            }
+            x = hp_carry;
+            hp_carry = hp >> (LEV_WORD_BITS - 1);
+            hp = (hp << 1) | x;
+            x = hn_carry;
+            hn_carry = hn >> (LEV_WORD_BITS - 1);
+            hn = (hn << 1) | x;
+            vp[b] = hn | ~(d0 | hp);
+            vn[b] = hp & d0;
+            if (NULL != col) {
+                col[LEV_COL_VP * nb_blocks + b] = vp[b];
+                col[LEV_COL_VN * nb_blocks + b] = vn[b];
             }
         }
     }
-    result = dbuf[(l1l2) - 1];
-    /* The following code computes an optimal alignment length */
+
+    return score;
+}
+
+/* Value (+1, -1 or 0) of the delta stored for row i (>= 1) of a column. */
+static inline long lev_delta(const uint64_t *col, size_t nb_blocks, int positive, int negative, size_t i)
+{
+    size_t b = (i - 1) / LEV_WORD_BITS;
+    size_t shift = (i - 1) % LEV_WORD_BITS;
+
+    return (long) ((col[positive * nb_blocks + b] >> shift) & 1) - (long) ((col[negative * nb_blocks + b] >> shift) & 1);
+}
+
+/*
+ * Optimal alignment length: walk back from (l1, l2), preferring the diagonal
+ * (match or substitution), then a deletion from s1, then an insertion; once
+ * a border is reached only the remaining gaps are left.
+ */
+static inline size_t lev_alignment_size(const char *s1, size_t l1, const char *s2, size_t l2, size_t distance, const uint64_t *cols,
+                                        size_t nb_blocks)
+{
+    size_t i, j, diag;
+    long cur, up, upleft, left, cost, take_diag, take_up;
+
     i = l1;
     j = l2;
-    *zsize = l1_1 + l2_1;
-    k = 0;
-    while ((i != -1) && (j != -1)) {
-        cost = (tolower(s1[i - 1]) == tolower(s2[j - 1])) ? 0 : 1;
-        if (dbuf[l2_1 * i + j] == (dbuf[l2_1 * (i - 1) + (j - 1)] + cost)) {
-            i--, j--, k++;
-        } else if (dbuf[l2_1 * i + j] == (dbuf[l2_1 * (i - 1) + j] + 1)) {
-                i--, k++;
-        } else {
-                j--, k++;
+    diag = 0;
+    cur = distance;
+    while ((i > 0) && (j > 0)) {
+        const uint64_t *col = cols + (j - 1) * LEV_COL_VECTORS * nb_blocks;
+
+        cost = (LEV_FOLD(s1[i - 1]) != LEV_FOLD(s2[j - 1]));
+        up = cur - lev_delta(col, nb_blocks, LEV_COL_VP, LEV_COL_VN, i);
+        upleft = up - ((i > 1) ? lev_delta(col, nb_blocks, LEV_COL_HP, LEV_COL_HN, i - 1) : 1);
+        left = cur - lev_delta(col, nb_blocks, LEV_COL_HP, LEV_COL_HN, i);
+        take_diag = (cur == upleft + cost);
+        take_up = !take_diag & (cur == up + 1);
+        cur = take_diag ? upleft : (take_up ? up : left);
+        diag += take_diag;
+        i -= take_diag | take_up;
+        j -= !take_up;
+    }
+
+    return l1 + l2 - diag;
+}
+
+/*
+ * Scalar kernel in linear memory: only one line of the matrix, over the
+ * shortest string, is kept. Each cell carries, next to D(i, j), the number of
+ * diagonal steps of the path the traceback above would follow from (i, j)
+ * (same preference order), so the alignment length is known at the end of
+ * the forward pass.
+ */
+struct lev_cell_t {
+    size_t d;
+    size_t diag;
+};
+
+static inline void lev_linear_cell(const struct lev_cell_t *upleft, const struct lev_cell_t *up, const struct lev_cell_t *left, int cost,
+                                   struct lev_cell_t *result)
+{
+    size_t d;
+
+    if (0 == cost) {
+        d = upleft->d;
+    }
+    else {
+        d = MIN3(up->d, left->d, upleft->d) + 1;
+    }
+    if (d == upleft->d + cost) {
+        result->diag = upleft->diag + 1;
+    }
+    else if (d == up->d + 1) {
+        result->diag = up->diag;
+    }
+    else {
+        result->diag = left->diag;
+    }
+    result->d = d;
+}
+
+static inline size_t lev_linear(const char *s1, size_t l1, const char *s2, size_t l2, struct lev_cell_t *line, size_t *zsize)
+{
+    struct lev_cell_t upleft, cur;
+    size_t i, j;
+
+    if (l1 <= l2) {
+        /* line[i] is column j: (i, j - 1) until overwritten by (i, j). */
+        for (i = 0; i <= l1; i++) {
+            line[i].d = i;
+            line[i].diag = 0;
         }
+        for (j = 1; j <= l2; j++) {
+            upleft = line[0];
+            line[0].d = j;
+            for (i = 1; i <= l1; i++) {
+                lev_linear_cell(&upleft, &line[i - 1], &line[i], LEV_FOLD(s1[i - 1]) != LEV_FOLD(s2[j - 1]), &cur);
+                upleft = line[i];
+                line[i] = cur;
+            }
+        }
+        *zsize = l1 + l2 - line[l1].diag;
+        return line[l1].d;
     }
-    while (i != -1) {
-        i--, k++;
+
+    /* line[j] is row i: (i - 1, j) until overwritten by (i, j). */
+    for (j = 0; j <= l2; j++) {
+        line[j].d = j;
+        line[j].diag = 0;
     }
-    while (j != -1) {
-        j--, k++;
+    for (i = 1; i <= l1; i++) {
+        upleft = line[0];
+        line[0].d = i;
+        for (j = 1; j <= l2; j++) {
+            lev_linear_cell(&upleft, &line[j], &line[j - 1], LEV_FOLD(s1[i - 1]) != LEV_FOLD(s2[j - 1]), &cur);
+            upleft = line[j];
+            line[j] = cur;
+        }
+    }
+    *zsize = l1 + l2 - line[l2].diag;
+    return line[l2].d;
+}
+
+static inline size_t levenshtein_distance_internal(const char *s1, size_t l1, const char *s2, size_t l2, size_t *zsize)
+{
+    uint64_t tmpbuf[LEV_TMPBUF_SIZE], *dbuf, *cols;
+    size_t nb_blocks, needed, result;
+
+    if ((0 == l1) || (0 == l2)) {
+        if (NULL != zsize)
+            *zsize = l1 + l2;
+        return l1 + l2;
+    }
+
+    nb_blocks = (l1 + LEV_WORD_BITS - 1) / LEV_WORD_BITS;
+    /*
+     * Peq and vp/vn of the current column for the block kernel, plus every
+     * column if we trace back.
+     */
+    needed = ((1 == nb_blocks) ? 0 : (256 + 2) * nb_blocks) + ((NULL != zsize) ? LEV_COL_VECTORS * nb_blocks * l2 : 0);
+    if ((NULL != zsize) && (needed > LEV_TMPBUF_SIZE)) {
+        struct lev_cell_t *line;
+
+        /* Columns would not fit on the stack: linear forward pass instead. */
+        if ((MIN(l1, l2) + 1) * sizeof(struct lev_cell_t) > sizeof(tmpbuf)) {
+            line = malloc((MIN(l1, l2) + 1) * sizeof(struct lev_cell_t));
+        }
+        else {
+            line = (struct lev_cell_t *) tmpbuf;
+        }
+        result = lev_linear(s1, l1, s2, l2, line, zsize);
+        if (line != (struct lev_cell_t *) tmpbuf)
+            free(line);
+
+        return result;
     }
-    *zsize = k - 1;
 
-    if(dbuf != tmpbuf)
+    if (needed > LEV_TMPBUF_SIZE) {
+        dbuf = malloc(needed * sizeof(uint64_t));
+    }
+    else {
+        dbuf = tmpbuf;
+    }
+    cols = (NULL != zsize) ? dbuf : NULL;
+
+    if (1 == nb_blocks) {
+        result = lev_myers_single(s1, l1, s2, l2, cols);
+    }
+    else {
+        uint64_t *peq = dbuf + ((NULL != zsize) ? LEV_COL_VECTORS * nb_blocks * l2 : 0);
+        result = lev_myers_block(s1, l1, s2, l2, peq, peq + 256 * nb_blocks, peq + 257 * nb_blocks, cols);
+    }
+
+    if (NULL != zsize)
+        *zsize = lev_alignment_size(s1, l1, s2, l2, result, cols, nb_blocks);
+
+    if (dbuf != tmpbuf)
         free(dbuf);
 
     return result;
@@ -74,8 +326,7 @@ static inline size_t levenshtein_distance_internal(const char *s1, size_t l1, co
 
 extern size_t levenshtein_distance(const char *s1, size_t l1, const char *s2, size_t l2)
 {
-    size_t zsize;
-    return levenshtein_distance_internal(s1, l1, s2, l2, &zsize);
+    return levenshtein_distance_internal(s1, l1, s2, l2, NULL);
 }
 
 extern float levenshtein_norm_distance(const char *s1, size_t l1, const char *s2, size_t l2)
@@ -93,12 +344,249 @@ extern float levenshtein_norm_distance(const char *s1, size_t l1, const char *s2
      */
 
     lev_d = levenshtein_distance_internal(s1, l1, s2, l2, &zsize);
+    if (0 == zsize)
+        return 1.0;
 
     result = (zsize - lev_d) / (float) zsize;
 
     return result;
 }
 
+/*
+ * Threshold-bounded kernel. The alignment length is at most (d + l1 + l2) / 2,
+ * so a pair reaching a similarity t has at most
+ * (1 - t) * (l1 + l2) / (1 + t) edits (computed with a small slack so that
+ * float rounding of the final score never rejects a pair the unbounded kernel
+ * would keep). An alignment with k edits only goes through diagonals j - i
+ * with |j - i| + |(l2 - l1) - (j - i)| <= k, so only that band of the matrix
+ * is computed (Ukkonen 1985); every cell whose distance is within the bound is
+ * exact there, and so is the traceback path leading to (l1, l2). The pass
+ * stops as soon as no cell of the current column can still reach (l1, l2)
+ * within the bound.
+ */
+#define LEV_SIM_SLACK 1e-6
+#define LEV_INFINITY (SIZE_MAX / 4)
+#define LEV_BAND_MAX_EDITS 4
+
+extern size_t levenshtein_max_edits(size_t l1, size_t l2, float min_similarity)
+{
+    double t = min_similarity - LEV_SIM_SLACK;
+
+    if (t <= 0.0)
+        return l1 + l2;
+
+    return (size_t) ((1.0 - t) * (l1 + l2) / (1.0 + t));
+}
+
+/* Distance within max_edits (>= |l2 - l1|), or LEV_INFINITY. */
+static inline size_t lev_banded(const char *s1, size_t l1, const char *s2, size_t l2, size_t max_edits, struct lev_cell_t *line,
+                                size_t *zsize)
+{
+    struct lev_cell_t upleft, up, cur;
+    long delta, half, lo_diag, hi_diag;
+    size_t i, j, first, last, rest, best;
+
+    delta = (long) l2 - (long) l1;
+    half = ((long) max_edits - ((delta < 0) ? -delta : delta)) / 2;
+    lo_diag = MIN(0, delta) - half;
+    hi_diag = MAX(0, delta) + half;
+
+    /* line[i] is column j: (i, j - 1) until overwritten by (i, j). */
+    for (i = 0; i <= l1; i++) {
+        line[i].d = ((long) i <= -lo_diag) ? i : LEV_INFINITY;
+        line[i].diag = 0;
+    }
+    for (j = 1; j <= l2; j++) {
+        first = ((long) j - hi_diag > 1) ? j - hi_diag : 1;
+        last = ((long) j - lo_diag < (long) l1) ? j - lo_diag : l1;
+        /* (first - 1, j - 1) is always in the band of the previous column. */
+        upleft = line[first - 1];
+        up.d = ((1 == first) && ((long) j <= hi_diag)) ? j : LEV_INFINITY;
+        up.diag = 0;
+        if (1 == first)
+            line[0] = up;
+        rest = (l1 > l2 - j) ? l1 - (l2 - j) : (l2 - j) - l1;
+        best = up.d + rest;
+        for (i = first; i <= last; i++) {
+            lev_linear_cell(&upleft, &up, &line[i], LEV_FOLD(s1[i - 1]) != LEV_FOLD(s2[j - 1]), &cur);
+            upleft = line[i];
+            line[i] = cur;
+            up = cur;
+            rest = (l1 - i > l2 - j) ? (l1 - i) - (l2 - j) : (l2 - j) - (l1 - i);
+            best = MIN(best, cur.d + rest);
+        }
+        if (best > max_edits)
+            return LEV_INFINITY;
+    }
+    *zsize = l1 + l2 - line[l1].diag;
+
+    return line[l1].d;
+}
+
+extern float levenshtein_norm_distance_bounded(const char *s1, size_t l1, const char *s2, size_t l2, float min_similarity)
+{
+    struct lev_cell_t tmpline[LEV_TMPBUF_SIZE / 2], *line;
+    size_t max_edits, lev_d, zsize = l1 + l2;
+    float result;
+
+    if ((0 == l1) || (0 == l2)) {
+        result = levenshtein_norm_distance(s1, l1, s2, l2);
+        return (result < min_similarity) ? LEVENSHTEIN_BELOW : result;
+    }
+
+    max_edits = levenshtein_max_edits(l1, l2, min_similarity);
+    if (((l1 > l2) ? l1 - l2 : l2 - l1) > max_edits)
+        return LEVENSHTEIN_BELOW;
+
+    /*
+     * Unless the band is very narrow, a pattern that fits a single word is
+     * rejected faster by the bit-parallel distance alone, and only the pairs
+     * within the bound pay for the traceback.
+     */
+    if ((l1 <= LEV_WORD_BITS) && (max_edits >= LEV_BAND_MAX_EDITS)) {
+        if (lev_myers_single(s1, l1, s2, l2, NULL) > max_edits)
+            return LEVENSHTEIN_BELOW;
+        result = levenshtein_norm_distance(s1, l1, s2, l2);
+        return (result < min_similarity) ? LEVENSHTEIN_BELOW : result;
+    }
+
+    if (l1 + 1 > sizeof(tmpline) / sizeof(tmpline[0])) {
+        line = malloc((l1 + 1) * sizeof(struct lev_cell_t));
+        if (NULL == line) {
+            perror("malloc");
+            return LEVENSHTEIN_BELOW;
+        }
+    }
+    else {
+        line = tmpline;
+    }
+    lev_d = lev_banded(s1, l1, s2, l2, max_edits, line, &zsize);
+    if (line != tmpline)
+        free(line);
+    if (lev_d > max_edits)
+        return LEVENSHTEIN_BELOW;
+
+    result = (zsize - lev_d) / (float) zsize;
+
+    return (result < min_similarity) ? LEVENSHTEIN_BELOW : result;
+}
+
+/*
+ * One-vs-many batch kernel: s1 against up to LEV_BATCH_LANES candidates at
+ * once, one candidate per SIMD lane, running the linear kernel above
+ * (distance and diagonal count of the traceback path in each cell) in every
+ * lane. Lanes are 8 bits wide, which holds every distance and
+ * diagonal count as long as both words are shorter than LEV_BATCH_MAX_LEN;
+ * longer pairs go through the scalar kernels. Lanes whose candidate is
+ * shorter than the longest of the batch pick their result up when their
+ * own last column goes by.
+ * The kernel is written with GCC vector extensions and cloned for AVX2,
+ * SSE4.1 and the baseline ISA; the clone is picked at load time from cpuid.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEV_BATCH_SIMD 1
+#define LEV_BATCH_BYTES 32
+#define LEV_BATCH_MAX_LEN 255
+#define LEV_BATCH_LANES LEV_BATCH_BYTES
+
+typedef uint8_t lev_vec_t __attribute__((vector_size(LEV_BATCH_BYTES)));
+
+#define LEV_VMIN(a, b) ((((lev_vec_t) ((a) < (b))) & (a)) | (~((lev_vec_t) ((a) < (b))) & (b)))
+
+__attribute__((target_clones("avx2", "sse4.1", "default")))
+static void lev_batch_u8(const char *s1, size_t l1, const char * const *s2, const size_t *l2, const size_t *idx, size_t nb,
+                         float *result)
+{
+    union {
+        lev_vec_t v;
+        uint8_t l[LEV_BATCH_LANES];
+    } text[LEV_BATCH_MAX_LEN], lengths, res_d, res_diag;
+    lev_vec_t line_d[LEV_BATCH_MAX_LEN + 1], line_diag[LEV_BATCH_MAX_LEN + 1];
+    lev_vec_t ul_d, ul_diag, d, diag, differ, cost, take_diag, take_up, last;
+    size_t i, j, k, max_l2;
+
+    max_l2 = 0;
+    for (k = 0; k < nb; k++)
+        max_l2 = MAX(max_l2, l2[k]);
+    memset(text, 0, max_l2 * sizeof(text[0]));
+    memset(&lengths, 0, sizeof(lengths));
+    for (k = 0; k < nb; k++) {
+        lengths.l[k] = l2[k];
+        for (j = 0; j < l2[k]; j++)
+            text[j].l[k] = LEV_FOLD(s2[k][j]);
+    }
+
+    /* line[i] is column j: (i, j - 1) until overwritten by (i, j). */
+    for (i = 0; i <= l1; i++) {
+        line_d[i] = (lev_vec_t) {} + (uint8_t) i;
+        line_diag[i] = (lev_vec_t) {};
+    }
+    res_d.v = res_diag.v = (lev_vec_t) {};
+    for (j = 1; j <= max_l2; j++) {
+        ul_d = line_d[0];
+        ul_diag = line_diag[0];
+        line_d[0] = (lev_vec_t) {} + (uint8_t) j;
+        for (i = 1; i <= l1; i++) {
+            differ = (lev_vec_t) (text[j - 1].v != (uint8_t) LEV_FOLD(s1[i - 1]));
+            cost = differ & 1;
+            /* d = differ ? MIN3(up, left, upleft) + 1 : upleft */
+            d = line_d[i - 1];
+            d = LEV_VMIN(d, line_d[i]);
+            d = LEV_VMIN(d, ul_d) + 1;
+            d = (differ & d) | (~differ & ul_d);
+            take_diag = (lev_vec_t) (d == ul_d + cost);
+            take_up = ~take_diag & (lev_vec_t) (d == line_d[i - 1] + 1);
+            diag = (take_diag & (ul_diag + 1)) | (take_up & line_diag[i - 1])
+                | (~(take_diag | take_up) & line_diag[i]);
+            ul_d = line_d[i];
+            ul_diag = line_diag[i];
+            line_d[i] = d;
+            line_diag[i] = diag;
+        }
+        last = (lev_vec_t) (lengths.v == (uint8_t) j);
+        res_d.v |= last & line_d[l1];
+        res_diag.v |= last & line_diag[l1];
+    }
+
+    for (k = 0; k < nb; k++) {
+        size_t zsize = l1 + l2[k] - res_diag.l[k];
+        result[idx[k]] = (zsize - res_d.l[k]) / (float) zsize;
+    }
+}
+#endif /* x86 and GNU C */
+
+extern void levenshtein_norm_distance_batch(const char *s1, size_t l1, const char * const *s2, const size_t *l2, size_t nb,
+                                            float *result)
+{
+    size_t k;
+#ifdef LEV_BATCH_SIMD
+    const char *lane_s2[LEV_BATCH_LANES];
+    size_t lane_l2[LEV_BATCH_LANES], lane_idx[LEV_BATCH_LANES];
+    size_t used;
+
+    if ((0 < l1) && (l1 < LEV_BATCH_MAX_LEN)) {
+        for (k = 0, used = 0; k < nb; k++) {
+            if ((0 == l2[k]) || (l2[k] >= LEV_BATCH_MAX_LEN)) {
+                result[k] = levenshtein_norm_distance(s1, l1, s2[k], l2[k]);
+                continue;
+            }
+            lane_s2[used] = s2[k];
+            lane_l2[used] = l2[k];
+            lane_idx[used] = k;
+            if (++used == LEV_BATCH_LANES) {
+                lev_batch_u8(s1, l1, lane_s2, lane_l2, lane_idx, used, result);
+                used = 0;
+            }
+        }
+        if (used > 0)
+            lev_batch_u8(s1, l1, lane_s2, lane_l2, lane_idx, used, result);
+        return;
+    }
+#endif
+    for (k = 0; k < nb; k++)
+        result[k] = levenshtein_norm_distance(s1, l1, s2[k], l2[k]);
+}
+
 /*
 int main(int argc, const char **argv)
 {
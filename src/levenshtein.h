@@ -24,4 +24,27 @@ size_t levenshtein_distance(const char *s1, size_t l1, const char *s2, size_t l2
 
 float levenshtein_norm_distance(const char *s1, size_t l1, const char *s2, size_t l2);
 
+/*
+ * Largest number of edits two words of lengths l1 and l2 can differ by while
+ * still reaching min_similarity.
+ */
+size_t levenshtein_max_edits(size_t l1, size_t l2, float min_similarity);
+
+/*
+ * Same as levenshtein_norm_distance when the result is at least
+ * min_similarity, LEVENSHTEIN_BELOW otherwise. Only the diagonal band that can
+ * still reach min_similarity is computed, and dissimilar pairs are given up
+ * as soon as the threshold is out of reach.
+ */
+#define LEVENSHTEIN_BELOW (-1.0f)
+
+float levenshtein_norm_distance_bounded(const char *s1, size_t l1, const char *s2, size_t l2, float min_similarity);
+
+/*
+ * Same as levenshtein_norm_distance for s1 against each of the nb words of
+ * s2 (lengths in l2), result[k] receiving the score of s2[k]. Uses SIMD lanes
+ * (one candidate per lane) when the CPU and the word lengths allow it.
+ */
+void levenshtein_norm_distance_batch(const char *s1, size_t l1, const char * const *s2, const size_t *l2, size_t nb, float *result);
+
 #endif /* LEVENSHTEIN_H */
@@ -18,6 +18,7 @@
 #include <stdio.h>
 
 #include "list.h"
+#include "pool.h"
 
 struct cell_t
 {
@@ -30,9 +31,28 @@ struct list_t
     cell_t *head;
     cell_t *tail;
     int nb_cells;
+    pool_t *cells; /** NULL: cells come from malloc. */
 };
 
-extern list_t *list_make(void)
+static inline cell_t *list_cell_alloc(list_t *list)
+{
+    return (NULL != list->cells) ? pool_alloc(list->cells) : malloc(sizeof(struct cell_t));
+}
+
+static inline void list_cell_free(list_t *list, cell_t *cell)
+{
+    if (NULL != list->cells)
+        pool_free(list->cells, cell);
+    else
+        free(cell);
+}
+
+extern pool_t *list_pool_make(size_t cells_per_slab)
+{
+    return pool_make(sizeof(struct cell_t), cells_per_slab);
+}
+
+extern list_t *list_make_with_pool(pool_t *cells)
 {
     list_t *list = malloc(sizeof(struct list_t));
 
@@ -40,11 +60,17 @@ extern list_t *list_make(void)
         list->head = NULL;
         list->tail = NULL;
         list->nb_cells = 0;
+        list->cells = cells;
     }
 
     return list;
 }
 
+extern list_t *list_make(void)
+{
+    return list_make_with_pool(NULL);
+}
+
 extern void list_release_container(list_t *list)
 {
     free(list);
@@ -55,7 +81,7 @@ extern int list_cons(list_t *list, void *element)
     cell_t *cell;
     int rc; /** return code. */
 
-    if (NULL != (cell = (cell_t *) malloc(sizeof(struct cell_t)))) {
+    if (NULL != (cell = list_cell_alloc(list))) {
         cell->data = element;
         cell->next = list->head;
         list->head = cell;
@@ -75,16 +101,22 @@ extern int list_cons(list_t *list, void *element)
 
 extern void list_remove(list_t *list, void *element)
 {
-    cell_t *cell;
+    cell_t **link, *cell;
 
-    for(cell = list->head; cell != NULL; cell = cell->next) {
-        if ((NULL != cell->next) && (cell->next->data == element)) {
-            if (list->tail == cell->next) {
-                list->tail = cell;
-            }
-            cell->next = cell->next->next;
+    for (link = &(list->head); NULL != (cell = *link);) {
+        if (cell->data == element) {
+            *link = cell->next;
+            list->nb_cells -= 1;
+            list_cell_free(list, cell);
+        }
+        else {
+            link = &(cell->next);
         }
     }
+    /* The tail is the last cell still linked (or none). */
+    list->tail = NULL;
+    for (cell = list->head; cell != NULL; cell = cell->next)
+        list->tail = cell;
 }
 
 extern int list_enqueue_elt(list_t *list, void *element)
@@ -92,7 +124,7 @@ extern int list_enqueue_elt(list_t *list, void *element)
     cell_t *cell;
     int rc; /** return code. */
 
-    if (NULL != (cell = (cell_t *) malloc(sizeof(struct cell_t)))) {
+    if (NULL != (cell = list_cell_alloc(list))) {
         cell->data = element;
         cell->next = NULL;
         if (NULL != list->tail) {
@@ -119,8 +151,10 @@ extern void list_cdr(list_t *list)
 
     cell = list->head->next;
     list->nb_cells -= 1;
-    free(list->head);
+    list_cell_free(list, list->head);
     list->head = cell;
+    if (NULL == cell)
+        list->tail = NULL;
 }
 
 extern void list_delete(list_t *list)
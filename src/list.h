@@ -17,11 +17,19 @@
 #ifndef LIST_H
 #define LIST_H
 
+#include "pool.h"
+
 typedef struct list_t list_t;
 typedef struct cell_t cell_t;
 
 list_t *list_make(void);
 
+/* A pool of cells, for list_make_with_pool. */
+pool_t *list_pool_make(size_t cells_per_slab);
+
+/* Cells of this list come from the pool, lists spliced by list_enqueue must share it. */
+list_t *list_make_with_pool(pool_t *cells);
+
 void list_release_container(list_t *list);
 
 int list_cons(list_t *list, void *element);
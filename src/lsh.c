@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "levenshtein.h"
+#include "lsh.h"
+
+/* Same folding as the distance kernels. */
+#define LSH_FOLD(c) ((uint32_t) ((((unsigned char) (c)) >= 'A' && ((unsigned char) (c)) <= 'Z') ? ((c) | 0x20) : (unsigned char) (c)))
+
+/* Hash functions computed at once, the signature is padded to a multiple. */
+#define LSH_LANES 8
+#define LSH_SEED 0x5eed5eedULL
+/* Longest word whose shingles are hashed, longer words are cut. */
+#define LSH_MAX_SHINGLES 1024
+
+struct lsh_key_t {
+    uint64_t key;
+    uint32_t word;
+};
+
+/*
+ * Hash function i maps a shingle x to a[i] * x + b[i] (mod 2^32), a[i] odd,
+ * and the signature keeps the minimum over the shingles of the word. Only the
+ * key of each band (a hash of its rows) is kept, bands keys per word.
+ * Candidates are kept as the following candidates of each word: those of
+ * word w are targets[offsets[w]] to targets[offsets[w + 1] - 1], sorted.
+ * Buckets of more than LSH_MAX_BUCKET words only pair each word with the
+ * LSH_MAX_BUCKET - 1 following it, the pairs left out are counted.
+ */
+struct lsh_t {
+    const char * const *words;
+    const size_t *lens;
+    size_t nb_words, bands, rows, nb_hashes;
+    uint32_t *a, *b;
+    uint64_t *keys;
+    size_t *offsets;
+    uint32_t *targets;
+    size_t nb_oversized, nb_skipped;
+};
+
+/* splitmix64: the hash functions and the samples are the same on each run. */
+static uint64_t lsh_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* LSH_LANES functions at once (GCC vector extensions, cloned for AVX2 and the SSE2 baseline). */
+__attribute__((target_clones("avx2", "default")))
+static void lsh_signature(const uint32_t *a, const uint32_t *b, size_t nb_hashes, const uint32_t *shingles, size_t nb_shingles,
+                          uint32_t *signature)
+{
+    typedef uint32_t vec_t __attribute__((vector_size(LSH_LANES * sizeof(uint32_t))));
+    vec_t va, vb, h, mask, sig;
+    size_t i, s;
+
+    for (i = 0; i < nb_hashes; i += LSH_LANES) {
+        memcpy(&va, a + i, sizeof(vec_t));
+        memcpy(&vb, b + i, sizeof(vec_t));
+        sig = ~(vec_t) {};
+        for (s = 0; s < nb_shingles; s++) {
+            h = va * shingles[s] + vb;
+            mask = (vec_t) (h < sig);
+            sig = (h & mask) | (sig & ~mask);
+        }
+        memcpy(signature + i, &sig, sizeof(vec_t));
+    }
+}
+#else
+static void lsh_signature(const uint32_t *a, const uint32_t *b, size_t nb_hashes, const uint32_t *shingles, size_t nb_shingles,
+                          uint32_t *signature)
+{
+    uint32_t h;
+    size_t i, s;
+
+    for (i = 0; i < nb_hashes; i++) {
+        for (s = 0, signature[i] = UINT32_MAX; s < nb_shingles; s++) {
+            h = a[i] * shingles[s] + b[i];
+            if (h < signature[i])
+                signature[i] = h;
+        }
+    }
+}
+#endif /* x86 and GNU C */
+
+lsh_t *lsh_make(const char * const *words, const size_t *lens, size_t nb_words, size_t bands, size_t rows)
+{
+    lsh_t *lsh;
+    uint64_t state = LSH_SEED;
+    size_t i;
+
+    if ((0 == bands) || (0 == rows) || (bands * rows > LSH_MAX_HASHES)) {
+        fprintf(stderr, "lsh: %zu bands of %zu rows, at most %d hashes\n", bands, rows, LSH_MAX_HASHES);
+        return NULL;
+    }
+    if (NULL == (lsh = calloc(1, sizeof(lsh_t))))
+        return NULL;
+    lsh->words = words;
+    lsh->lens = lens;
+    lsh->nb_words = nb_words;
+    lsh->bands = bands;
+    lsh->rows = rows;
+    lsh->nb_hashes = (bands * rows + LSH_LANES - 1) / LSH_LANES * LSH_LANES;
+    lsh->a = malloc(lsh->nb_hashes * sizeof(uint32_t));
+    lsh->b = malloc(lsh->nb_hashes * sizeof(uint32_t));
+    lsh->keys = malloc((nb_words * bands + 1) * sizeof(uint64_t));
+    if ((NULL == lsh->a) || (NULL == lsh->b) || (NULL == lsh->keys)) {
+        lsh_destroy(lsh);
+        return NULL;
+    }
+    for (i = 0; i < lsh->nb_hashes; i++) {
+        lsh->a[i] = (uint32_t) lsh_random(&state) | 1;
+        lsh->b[i] = (uint32_t) lsh_random(&state);
+    }
+
+    return lsh;
+}
+
+void lsh_destroy(lsh_t *lsh)
+{
+    if (NULL != lsh) {
+        free(lsh->a);
+        free(lsh->b);
+        free(lsh->keys);
+        free(lsh->offsets);
+        free(lsh->targets);
+        free(lsh);
+    }
+}
+
+void lsh_sign(lsh_t *lsh, size_t first, size_t last)
+{
+    uint32_t shingles[LSH_MAX_SHINGLES], signature[LSH_MAX_HASHES + LSH_LANES], x;
+    size_t w, len, s, nb_shingles, band, row;
+    const char *word;
+    uint64_t key;
+
+    last = (last < lsh->nb_words) ? last : lsh->nb_words;
+    for (w = first; w < last; w++) {
+        word = lsh->words[w];
+        len = (lsh->lens[w] < LSH_MAX_SHINGLES) ? lsh->lens[w] : LSH_MAX_SHINGLES;
+        /* A word shorter than a shingle is its only shingle. */
+        nb_shingles = (len < LSH_SHINGLE) ? 1 : len - LSH_SHINGLE + 1;
+        for (s = 0; s < nb_shingles; s++) {
+            x = LSH_FOLD(word[s]);
+            if (s + 1 < len)
+                x |= LSH_FOLD(word[s + 1]) << 8;
+            if (s + 2 < len)
+                x |= LSH_FOLD(word[s + 2]) << 16;
+            /* Spread the characters over every bit before the multiplications. */
+            x *= 0x9e3779b1u;
+            shingles[s] = x ^ (x >> 16);
+        }
+        lsh_signature(lsh->a, lsh->b, lsh->nb_hashes, shingles, nb_shingles, signature);
+        for (band = 0; band < lsh->bands; band++) {
+            for (row = 0, key = band + 1; row < lsh->rows; row++) {
+                key = (key ^ signature[band * lsh->rows + row]) * 0x9e3779b97f4a7c15ULL;
+                key ^= key >> 29;
+            }
+            lsh->keys[w * lsh->bands + band] = key;
+        }
+    }
+}
+
+static int lsh_key_cmp(const void *data1, const void *data2)
+{
+    const struct lsh_key_t *k1 = data1;
+    const struct lsh_key_t *k2 = data2;
+
+    if (k1->key != k2->key)
+        return (k1->key < k2->key) ? -1 : 1;
+
+    return (k1->word < k2->word) ? -1 : ((k1->word > k2->word) ? 1 : 0);
+}
+
+static int lsh_target_cmp(const void *data1, const void *data2)
+{
+    uint32_t t1 = *(const uint32_t *) data1;
+    uint32_t t2 = *(const uint32_t *) data2;
+
+    return (t1 < t2) ? -1 : ((t1 > t2) ? 1 : 0);
+}
+
+int lsh_bucket(lsh_t *lsh)
+{
+    struct lsh_key_t *keys;
+    uint32_t *members, *positions, *ends, *gathered, *targets;
+    size_t n = lsh->nb_words, band, w, start, end, i, size, kept, nb_gathered, nb_targets, max_targets;
+    int rv = -1;
+
+    keys = malloc((n + 1) * sizeof(struct lsh_key_t));
+    members = malloc((n * lsh->bands + 1) * sizeof(uint32_t));
+    positions = malloc((n * lsh->bands + 1) * sizeof(uint32_t));
+    ends = malloc((n * lsh->bands + 1) * sizeof(uint32_t));
+    gathered = malloc((lsh->bands * LSH_MAX_BUCKET + 1) * sizeof(uint32_t));
+    lsh->offsets = calloc(n + 1, sizeof(size_t));
+    if ((NULL == keys) || (NULL == members) || (NULL == positions) || (NULL == ends) || (NULL == gathered) || (NULL == lsh->offsets)) {
+        perror("malloc");
+        goto out;
+    }
+    for (band = 0; band < lsh->bands; band++) {
+        for (w = 0; w < n; w++) {
+            keys[w].key = lsh->keys[w * lsh->bands + band];
+            keys[w].word = (uint32_t) w;
+        }
+        /* A bucket is a run of equal keys, its words in increasing order. */
+        qsort(keys, n, sizeof(struct lsh_key_t), lsh_key_cmp);
+        for (start = 0; start < n; start = end) {
+            for (end = start + 1; (end < n) && (keys[end].key == keys[start].key); end++);
+            for (i = start; i < end; i++) {
+                members[band * n + i] = keys[i].word;
+                positions[band * n + keys[i].word] = (uint32_t) i;
+                ends[band * n + keys[i].word] = (uint32_t) end;
+            }
+            size = end - start;
+            if (size > LSH_MAX_BUCKET) {
+                lsh->nb_oversized++;
+                lsh->nb_skipped += size * (size - 1) / 2 - (size - LSH_MAX_BUCKET + 1) * (LSH_MAX_BUCKET - 1)
+                    - (LSH_MAX_BUCKET - 1) * (LSH_MAX_BUCKET - 2) / 2;
+            }
+        }
+    }
+    free(lsh->keys);
+    lsh->keys = NULL;
+
+    /* Word by word, a pair sharing several bands is kept once. */
+    targets = NULL;
+    nb_targets = max_targets = 0;
+    for (w = 0; w < n; w++) {
+        for (band = 0, nb_gathered = 0; band < lsh->bands; band++) {
+            end = ends[band * n + w];
+            if (end > positions[band * n + w] + LSH_MAX_BUCKET)
+                end = positions[band * n + w] + LSH_MAX_BUCKET;
+            for (i = positions[band * n + w] + 1; i < end; i++)
+                gathered[nb_gathered++] = members[band * n + i];
+        }
+        qsort(gathered, nb_gathered, sizeof(uint32_t), lsh_target_cmp);
+        for (i = 0, kept = 0; i < nb_gathered; i++) {
+            if ((0 == kept) || (gathered[kept - 1] != gathered[i]))
+                gathered[kept++] = gathered[i];
+        }
+        if (nb_targets + kept > max_targets) {
+            for (max_targets = (0 == max_targets) ? 1024 : max_targets; nb_targets + kept > max_targets; max_targets *= 2);
+            if (NULL == (targets = realloc(lsh->targets, max_targets * sizeof(uint32_t)))) {
+                perror("realloc");
+                goto out;
+            }
+            lsh->targets = targets;
+        }
+        memcpy(lsh->targets + nb_targets, gathered, kept * sizeof(uint32_t));
+        nb_targets += kept;
+        lsh->offsets[w + 1] = nb_targets;
+    }
+    rv = 0;
+
+out:
+    free(keys);
+    free(members);
+    free(positions);
+    free(ends);
+    free(gathered);
+
+    return rv;
+}
+
+size_t lsh_nb_candidates(const lsh_t *lsh)
+{
+    return (NULL == lsh->offsets) ? 0 : lsh->offsets[lsh->nb_words];
+}
+
+void lsh_oversized(const lsh_t *lsh, size_t *nb_buckets, size_t *nb_pairs)
+{
+    *nb_buckets = lsh->nb_oversized;
+    *nb_pairs = lsh->nb_skipped;
+}
+
+size_t lsh_candidates(const lsh_t *lsh, size_t word, size_t end, size_t *candidates)
+{
+    size_t t, nb;
+
+    for (t = lsh->offsets[word], nb = 0; (t < lsh->offsets[word + 1]) && (lsh->targets[t] < end); t++)
+        candidates[nb++] = lsh->targets[t];
+
+    return nb;
+}
+
+static int lsh_is_candidate(const lsh_t *lsh, size_t word_1, size_t word_2)
+{
+    size_t lo, hi, mid;
+
+    for (lo = lsh->offsets[word_1], hi = lsh->offsets[word_1 + 1]; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+        if (lsh->targets[mid] == word_2)
+            return 1;
+        if (lsh->targets[mid] < word_2)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return 0;
+}
+
+void lsh_recall(const lsh_t *lsh, float cutoff, size_t nb_samples, size_t *nb_similar, size_t *nb_found)
+{
+    uint64_t state = LSH_SEED;
+    size_t s, i, j, w1, w2;
+
+    *nb_similar = *nb_found = 0;
+    if (nb_samples > lsh->nb_words)
+        nb_samples = lsh->nb_words;
+    for (s = 0; s < nb_samples; s++) {
+        /* Every word when there are not more than samples, random ones otherwise. */
+        i = (nb_samples == lsh->nb_words) ? s : (size_t) (lsh_random(&state) % lsh->nb_words);
+        for (j = 0; j < lsh->nb_words; j++) {
+            if (j == i)
+                continue;
+            w1 = (i < j) ? i : j;
+            w2 = (i < j) ? j : i;
+            if (LEVENSHTEIN_BELOW == levenshtein_norm_distance_bounded(lsh->words[w1], lsh->lens[w1], lsh->words[w2], lsh->lens[w2],
+                                                                       cutoff))
+                continue;
+            (*nb_similar)++;
+            if (lsh_is_candidate(lsh, w1, w2))
+                (*nb_found)++;
+        }
+    }
+}
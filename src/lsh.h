@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef LSH_H
+#define LSH_H
+
+#include <stddef.h>
+
+/* Characters of a shingle. */
+#define LSH_SHINGLE 3
+/* At most this many MinHash functions (bands * rows). */
+#define LSH_MAX_HASHES 512
+/* Words of a bucket paired with each word: a few common shingles must not make a bucket quadratic. */
+#define LSH_MAX_BUCKET 256
+
+typedef struct lsh_t lsh_t;
+
+/**
+ * Make a new locality sensitive hashing of words: MinHash signatures of
+ * bands * rows functions over the (case insensitive) shingles of each word,
+ * and words sharing the rows of a band are candidate pairs.
+ * @param words The words, which must outlive the hashing.
+ * @param lens The length of each word.
+ * @param nb_words The number of words (smaller than 2^32).
+ * @param bands The number of bands.
+ * @param rows The number of rows of a band.
+ * @return Return a pointer to a newly allocated hashing, NULL if an error
+ * occured.
+ */
+lsh_t *lsh_make(const char * const *words, const size_t *lens, size_t nb_words, size_t bands, size_t rows);
+
+/**
+ * Deallocate the hashing.
+ * @param lsh The hashing you are working with.
+ */
+void lsh_destroy(lsh_t *lsh);
+
+/**
+ * Compute the signatures of words first to last - 1 (last is clipped to the
+ * number of words).
+ * @param lsh The hashing you are working with.
+ * @param first The first word.
+ * @param last The word after the last one.
+ * @remark Threads may sign distinct ranges of words at the same time.
+ */
+void lsh_sign(lsh_t *lsh, size_t first, size_t last);
+
+/**
+ * Gather the candidate pairs, once every word is signed. A word is paired
+ * with at most LSH_MAX_BUCKET - 1 words of each of its buckets, the
+ * following ones.
+ * @param lsh The hashing you are working with.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int lsh_bucket(lsh_t *lsh);
+
+/**
+ * Get the number of candidate pairs.
+ * @param lsh The hashing you are working with.
+ * @return The number of pairs sharing a band.
+ */
+size_t lsh_nb_candidates(const lsh_t *lsh);
+
+/**
+ * Get what the cap of the buckets left out.
+ * @param lsh The hashing you are working with.
+ * @param nb_buckets Receives the number of buckets of more than
+ * LSH_MAX_BUCKET words.
+ * @param nb_pairs Receives the number of their pairs which are not
+ * candidates (unless they share another band).
+ */
+void lsh_oversized(const lsh_t *lsh, size_t *nb_buckets, size_t *nb_pairs);
+
+/**
+ * Get the candidates of a word among the following ones.
+ * @param lsh The hashing you are working with.
+ * @param word The word.
+ * @param end The word after the last one to consider.
+ * @param candidates Receives the candidates between word + 1 and end - 1, in
+ * increasing order.
+ * @return The number of candidates.
+ */
+size_t lsh_candidates(const lsh_t *lsh, size_t word, size_t end, size_t *candidates);
+
+/**
+ * Estimate the recall of the candidates: a sample of words is compared to
+ * every other word, counting the pairs reaching the cutoff and those among
+ * them which are candidates.
+ * @param lsh The hashing you are working with.
+ * @param cutoff The similarity of the pairs looked for.
+ * @param nb_samples The number of words sampled (the same ones on each run).
+ * @param nb_similar Receives the number of pairs reaching the cutoff.
+ * @param nb_found Receives the number of those pairs which are candidates.
+ */
+void lsh_recall(const lsh_t *lsh, float cutoff, size_t nb_samples, size_t *nb_similar, size_t *nb_found);
+
+#endif /* LSH_H */
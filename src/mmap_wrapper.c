@@ -16,6 +16,7 @@
 /* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
 
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -26,6 +27,15 @@
 
 #define DEF_MULT_WIN 1024
 
+/*
+ * With a 64 bits address space any file fits: it is mapped whole, once, and
+ * the pointers handed out stay valid until mmap_wrapper_delete. Otherwise a
+ * window of DEF_MULT_WIN pages slides along the file.
+ */
+#if UINTPTR_MAX > 0xffffffffu
+#define MMAP_WHOLE_FILE 1
+#endif
+
 struct mmap_wrapper_t
 {
     off_t offset;
@@ -66,9 +76,13 @@ extern int mmap_wrapper_init(mmap_wrapper_t **mw, const char *fname)
 
     result->page_size = sysconf(_SC_PAGE_SIZE);
     result->offset = 0;
+#ifdef MMAP_WHOLE_FILE
+    result->msize = result->fsize;
+#else
     result->msize = result->page_size * DEF_MULT_WIN;
+#endif
 
-    if (result->msize > result->fsize) {
+    if (result->msize >= result->fsize) {
 	result->msize = result->fsize;
 	result->last_window = 1;
     }
@@ -83,10 +97,20 @@ extern int mmap_wrapper_init(mmap_wrapper_t **mw, const char *fname)
 	free(result);
 	return -1;
     }
+#ifdef MMAP_WHOLE_FILE
+    /* Read ahead of the tokenizer, only a hint: failures are harmless. */
+    madvise(result->mm, result->msize, MADV_SEQUENTIAL);
+    madvise(result->mm, result->msize, MADV_WILLNEED);
+#endif
 
     return 0;
 }
 
+extern int mmap_wrapper_whole(const mmap_wrapper_t *mw)
+{
+    return (0 == mw->offset) && (0 != mw->last_window);
+}
+
 static inline const char *mmap_wrapper_get_ptr(mmap_wrapper_t *mw)
 {
     return (const char *) mw->mm;
@@ -177,6 +201,7 @@ extern int mmap_wrapper_delete(mmap_wrapper_t *mw)
 	perror("error calling close");
 	return -1;
     }
+    free(mw);
 
     return 0;
 }
@@ -190,6 +215,56 @@ static inline size_t my_memcharcspn(const char *s, int limit, size_t len)
     return (NULL == res) ? len : (res - s);
 }
 
+/*
+ * Bounded strcspn: length of the prefix of s (at most len bytes) without any
+ * of the separators. Blocks of MMAP_SCAN_BYTES are compared to each
+ * separator at once (GCC vector extensions, cloned for AVX2 and the SSE2
+ * baseline), and the first hit is found from the 64 bits words of the
+ * comparison mask.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MMAP_SCAN_SIMD 1
+#define MMAP_SCAN_BYTES 32
+
+__attribute__((target_clones("avx2", "default")))
+static size_t mmap_scan_simd(const char *s, size_t len, const char *separators, size_t nb_separators)
+{
+    typedef unsigned char vec_t __attribute__((vector_size(MMAP_SCAN_BYTES)));
+    union {
+	vec_t v;
+	uint64_t w[MMAP_SCAN_BYTES / 8];
+    } hit;
+    vec_t block;
+    size_t i, k;
+
+    for (i = 0; i + MMAP_SCAN_BYTES <= len; i += MMAP_SCAN_BYTES) {
+	memcpy(&block, s + i, MMAP_SCAN_BYTES);
+	hit.v = (vec_t) {};
+	for (k = 0; k < nb_separators; k++)
+	    hit.v |= (vec_t) (block == (unsigned char) separators[k]);
+	for (k = 0; k < MMAP_SCAN_BYTES / 8; k++) {
+	    /* x86 is little endian: the lowest set byte is the first hit. */
+	    if (0 != hit.w[k])
+	        return i + 8 * k + __builtin_ctzll(hit.w[k]) / 8;
+	}
+    }
+
+    return i;
+}
+#endif /* x86 and GNU C */
+
+static inline size_t mmap_scan(const char *s, size_t len, const char *separators)
+{
+    size_t i = 0, nb_separators = strlen(separators);
+
+#ifdef MMAP_SCAN_SIMD
+    i = mmap_scan_simd(s, len, separators, nb_separators);
+#endif
+    for (; (i < len) && (NULL == memchr(separators, s[i], nb_separators)); i++);
+
+    return i;
+}
+
 extern int mmap_get_head(mmap_wrapper_t *mw, size_t * idx)
 {
     if ((0 == mmap_wrapper_get_limit(mw)) && (0 != mmap_wrapper_last_window(mw))) {
@@ -247,7 +322,7 @@ extern int mmap_get_next2(mmap_wrapper_t *mw, size_t * idx, const char *separato
 
     while ((((*idx < mmap_wrapper_get_limit(mw)) || (0 == mmap_wrapper_last_window(mw)))) && (!found)) {
 	ptr = mmap_wrapper_get_ptr(mw);
-	wordlen = strcspn(ptr + *idx, separators);
+	wordlen = mmap_scan(ptr + *idx, mmap_wrapper_get_limit(mw) - *idx, separators);
 	*idx += wordlen + 1;
 
 	if ((mmap_wrapper_get_limit(mw) <= *idx)) {
@@ -317,7 +392,7 @@ extern const char *mmap_get_line2(mmap_wrapper_t *mw, size_t * idx, size_t * len
     *len = 0;
     ptr = mmap_wrapper_get_ptr(mw);
     for (i = 1; ((*idx < mmap_wrapper_get_limit(mw)) || (0 == mmap_wrapper_last_window(mw))) && (!found); i++) {
-	*len = strcspn(ptr + *idx, separators);
+	*len = mmap_scan(ptr + *idx, mmap_wrapper_get_limit(mw) - *idx, separators);
 
 	if ((mmap_wrapper_get_limit(mw) == (*idx + *len))
 	    && (0 == mmap_wrapper_last_window(mw))) {
@@ -347,3 +422,41 @@ extern off_t mmap_wrapper_get_abs_pos(mmap_wrapper_t *mw, size_t idx)
 
     return result;
 }
+
+/* First token start at or after pos. */
+static size_t mmap_chunk_align(const mmap_wrapper_t *mw, size_t pos, const char *separators)
+{
+    const char *ptr = (const char *) mw->mm;
+
+    if ((0 == pos) || (NULL != memchr(separators, ptr[pos - 1], strlen(separators))))
+	return pos;
+    pos += mmap_scan(ptr + pos, mw->msize - pos, separators) + 1;
+
+    return (pos < mw->msize) ? pos : mw->msize;
+}
+
+extern int mmap_chunk_init(const mmap_wrapper_t *mw, mmap_chunk_t *chunk, size_t n, size_t nb_chunks, const char *separators)
+{
+    if (!mmap_wrapper_whole(mw) || (n >= nb_chunks)) {
+	fprintf(stderr, "chunks need the whole file mapped\n");
+	return -1;
+    }
+    chunk->separators = separators;
+    chunk->idx = mmap_chunk_align(mw, mw->msize / nb_chunks * n, separators);
+    chunk->end = (n + 1 == nb_chunks) ? mw->msize : mmap_chunk_align(mw, mw->msize / nb_chunks * (n + 1), separators);
+
+    return 0;
+}
+
+extern const char *mmap_chunk_next(const mmap_wrapper_t *mw, mmap_chunk_t *chunk, size_t *len)
+{
+    const char *ptr = (const char *) mw->mm + chunk->idx;
+
+    if (chunk->idx >= chunk->end)
+	return NULL;
+    /* The last token of a chunk may run past its end, up to a separator. */
+    *len = mmap_scan(ptr, mw->msize - chunk->idx, chunk->separators);
+    chunk->idx += *len + 1;
+
+    return ptr;
+}
@@ -27,6 +27,12 @@ int mmap_wrapper_init(mmap_wrapper_t **mw, const char *fname);
 
 int mmap_wrapper_delete(mmap_wrapper_t *mw);
 
+/*
+ * Whether the whole file is mapped at once: the pointers given by
+ * mmap_get_line and mmap_get_line2 then stay valid until mmap_wrapper_delete.
+ */
+int mmap_wrapper_whole(const mmap_wrapper_t *mw);
+
 int mmap_get_head(mmap_wrapper_t *mw, size_t * idx);
 
 int mmap_get_next(mmap_wrapper_t *mw, size_t * idx, char separator);
@@ -39,4 +45,25 @@ const char *mmap_get_line2(mmap_wrapper_t *mw, size_t * idx, size_t * len, const
 
 off_t mmap_wrapper_get_abs_pos(mmap_wrapper_t *mw, size_t idx);
 
+/*
+ * Chunk iterator, for a file mapped whole: the file is cut in nb_chunks byte
+ * ranges of about the same size, each one moved forward to the start of a
+ * token, so that every token belongs to exactly one chunk and chunks can be
+ * tokenized concurrently. Going through the chunks in order gives the same
+ * tokens as mmap_get_line2/mmap_get_next2 over the file.
+ */
+struct mmap_chunk_t {
+    const char *separators;
+    size_t idx, end;
+};
+typedef struct mmap_chunk_t mmap_chunk_t;
+
+int mmap_chunk_init(const mmap_wrapper_t *mw, mmap_chunk_t *chunk, size_t n, size_t nb_chunks, const char *separators);
+
+/*
+ * Next token of the chunk, NULL once the chunk is exhausted; it stays valid
+ * until mmap_wrapper_delete.
+ */
+const char *mmap_chunk_next(const mmap_wrapper_t *mw, mmap_chunk_t *chunk, size_t *len);
+
 #endif /* MMAP_WRAPPER_H */
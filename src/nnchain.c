@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "nnchain.h"
+
+/*
+ * Nodes 0 to nb_points - 1 are the points, each merge makes a new node. A
+ * node only has edges to the nodes it may still be merged with: the edges of
+ * a merged node are those its two halves share (Lance-Williams update of
+ * complete linkage, a missing edge being below any similarity). Edges to
+ * merged nodes are dropped lazily, when the edges are walked or grown.
+ */
+#define NNCHAIN_NONE SIZE_MAX
+
+#define NNCHAIN_ACTIVE 0
+#define NNCHAIN_MERGED 1
+/* No edge left: the node is a cluster of the result. */
+#define NNCHAIN_FINAL 2
+
+struct nnchain_edge_t {
+    size_t node;
+    float value;
+};
+
+struct nnchain_node_t {
+    struct nnchain_edge_t *edges;
+    size_t nb_edges, max_edges;
+    /* Points of the node, chained through next_point. */
+    size_t first, last, nb_points;
+    int state;
+};
+
+struct nnchain_t {
+    struct nnchain_node_t *nodes;
+    size_t nb_points, nb_nodes;
+    size_t *next_point;
+    size_t *chain;
+    /* Edges of the second half of the merge being made, by node. */
+    size_t *stamp;
+    float *stamp_value;
+    /* Work area of nnchain_clusters. */
+    size_t *points;
+};
+
+nnchain_t *nnchain_make(size_t nb_points)
+{
+    nnchain_t *nnchain;
+    size_t i, max_nodes = 2 * nb_points + 1;
+
+    if (NULL == (nnchain = calloc(1, sizeof(nnchain_t))))
+        return NULL;
+    nnchain->nb_points = nnchain->nb_nodes = nb_points;
+    nnchain->nodes = calloc(max_nodes, sizeof(struct nnchain_node_t));
+    nnchain->next_point = malloc((nb_points + 1) * sizeof(size_t));
+    nnchain->chain = malloc((nb_points + 1) * sizeof(size_t));
+    nnchain->stamp = malloc(max_nodes * sizeof(size_t));
+    nnchain->stamp_value = malloc(max_nodes * sizeof(float));
+    nnchain->points = malloc((nb_points + 1) * sizeof(size_t));
+    if ((NULL == nnchain->nodes) || (NULL == nnchain->next_point) || (NULL == nnchain->chain) || (NULL == nnchain->stamp)
+        || (NULL == nnchain->stamp_value) || (NULL == nnchain->points)) {
+        nnchain_destroy(nnchain);
+        return NULL;
+    }
+    for (i = 0; i < max_nodes; i++)
+        nnchain->stamp[i] = NNCHAIN_NONE;
+    for (i = 0; i < nb_points; i++) {
+        nnchain->nodes[i].first = nnchain->nodes[i].last = i;
+        nnchain->nodes[i].nb_points = 1;
+        nnchain->next_point[i] = NNCHAIN_NONE;
+    }
+
+    return nnchain;
+}
+
+void nnchain_destroy(nnchain_t *nnchain)
+{
+    size_t i;
+
+    if (NULL != nnchain) {
+        if (NULL != nnchain->nodes) {
+            for (i = 0; i < nnchain->nb_nodes; i++)
+                free(nnchain->nodes[i].edges);
+        }
+        free(nnchain->nodes);
+        free(nnchain->next_point);
+        free(nnchain->chain);
+        free(nnchain->stamp);
+        free(nnchain->stamp_value);
+        free(nnchain->points);
+        free(nnchain);
+    }
+}
+
+/* Drop the edges to merged nodes. */
+static void nnchain_compact(nnchain_t *nnchain, struct nnchain_node_t *node)
+{
+    size_t e, kept;
+
+    for (e = 0, kept = 0; e < node->nb_edges; e++) {
+        if (NNCHAIN_ACTIVE == nnchain->nodes[node->edges[e].node].state)
+            node->edges[kept++] = node->edges[e];
+    }
+    node->nb_edges = kept;
+}
+
+static int nnchain_link(nnchain_t *nnchain, size_t from, size_t to, float value)
+{
+    struct nnchain_node_t *node = nnchain->nodes + from;
+    struct nnchain_edge_t *edges;
+    size_t new_max;
+
+    if (node->nb_edges == node->max_edges) {
+        nnchain_compact(nnchain, node);
+    }
+    if (node->nb_edges == node->max_edges) {
+        new_max = (0 == node->max_edges) ? 4 : 2 * node->max_edges;
+        if (NULL == (edges = realloc(node->edges, new_max * sizeof(struct nnchain_edge_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        node->edges = edges;
+        node->max_edges = new_max;
+    }
+    node->edges[node->nb_edges].node = to;
+    node->edges[node->nb_edges].value = value;
+    node->nb_edges++;
+
+    return 0;
+}
+
+int nnchain_add(nnchain_t *nnchain, size_t point_1, size_t point_2, float value)
+{
+    if ((0 != nnchain_link(nnchain, point_1, point_2, value)) || (0 != nnchain_link(nnchain, point_2, point_1, value)))
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Most similar node to a node, NNCHAIN_NONE if it has no edge left. Ties go
+ * to the node before it in the chain, which guarantees the chain ends with a
+ * pair of reciprocal nearest neighbors, then to the smallest node.
+ */
+static size_t nnchain_nearest(nnchain_t *nnchain, size_t node, size_t previous)
+{
+    struct nnchain_node_t *n = nnchain->nodes + node;
+    size_t e, best = NNCHAIN_NONE;
+    float best_value = 0.0;
+
+    nnchain_compact(nnchain, n);
+    for (e = 0; e < n->nb_edges; e++) {
+        if ((NNCHAIN_NONE == best) || (n->edges[e].value > best_value)
+            || ((n->edges[e].value == best_value)
+                && ((n->edges[e].node == previous) || ((best != previous) && (n->edges[e].node < best))))) {
+            best = n->edges[e].node;
+            best_value = n->edges[e].value;
+        }
+    }
+
+    return best;
+}
+
+static int nnchain_merge(nnchain_t *nnchain, size_t node_1, size_t node_2)
+{
+    struct nnchain_node_t *n1 = nnchain->nodes + node_1, *n2 = nnchain->nodes + node_2, *merged;
+    size_t e, other, node = nnchain->nb_nodes++;
+    float value;
+
+    merged = nnchain->nodes + node;
+    for (e = 0; e < n2->nb_edges; e++) {
+        nnchain->stamp[n2->edges[e].node] = node;
+        nnchain->stamp_value[n2->edges[e].node] = n2->edges[e].value;
+    }
+    n1->state = n2->state = NNCHAIN_MERGED;
+    for (e = 0; e < n1->nb_edges; e++) {
+        other = n1->edges[e].node;
+        if ((NNCHAIN_ACTIVE != nnchain->nodes[other].state) || (node != nnchain->stamp[other]))
+            continue;
+        value = n1->edges[e].value;
+        if (nnchain->stamp_value[other] < value)
+            value = nnchain->stamp_value[other];
+        if ((0 != nnchain_link(nnchain, node, other, value)) || (0 != nnchain_link(nnchain, other, node, value)))
+            return -1;
+    }
+
+    merged->state = NNCHAIN_ACTIVE;
+    merged->first = n1->first;
+    merged->last = n2->last;
+    merged->nb_points = n1->nb_points + n2->nb_points;
+    nnchain->next_point[n1->last] = n2->first;
+    free(n1->edges);
+    free(n2->edges);
+    n1->edges = n2->edges = NULL;
+    n1->nb_edges = n2->nb_edges = n1->max_edges = n2->max_edges = 0;
+
+    return 0;
+}
+
+int nnchain_run(nnchain_t *nnchain)
+{
+    size_t nb_chain, start, top, previous, nearest;
+
+    for (nb_chain = 0, start = 0;;) {
+        if (0 == nb_chain) {
+            while ((start < nnchain->nb_nodes) && (NNCHAIN_ACTIVE != nnchain->nodes[start].state))
+                start++;
+            if (start == nnchain->nb_nodes)
+                break;
+            nnchain->chain[nb_chain++] = start;
+        }
+        top = nnchain->chain[nb_chain - 1];
+        previous = (nb_chain > 1) ? nnchain->chain[nb_chain - 2] : NNCHAIN_NONE;
+        nearest = nnchain_nearest(nnchain, top, previous);
+        if (NNCHAIN_NONE == nearest) {
+            /* Edges are symmetric: a node without any is alone in the chain. */
+            nnchain->nodes[top].state = NNCHAIN_FINAL;
+            nb_chain--;
+        }
+        else if (nearest == previous) {
+            nb_chain -= 2;
+            if (0 != nnchain_merge(nnchain, (previous < top) ? previous : top, (previous < top) ? top : previous))
+                return -1;
+        }
+        else {
+            nnchain->chain[nb_chain++] = nearest;
+        }
+    }
+
+    return 0;
+}
+
+static int nnchain_cluster(nnchain_t *nnchain, size_t node, nnchain_cluster_callback_fn_t *cluster, void *ctx)
+{
+    size_t point, nb_points;
+
+    for (nb_points = 0, point = nnchain->nodes[node].first; NNCHAIN_NONE != point; point = nnchain->next_point[point])
+        nnchain->points[nb_points++] = point;
+
+    return cluster(ctx, nnchain->points, nb_points);
+}
+
+int nnchain_clusters(nnchain_t *nnchain, nnchain_cluster_callback_fn_t *cluster, void *ctx)
+{
+    size_t node;
+
+    for (node = nnchain->nb_points; node < nnchain->nb_nodes; node++) {
+        if ((NNCHAIN_FINAL == nnchain->nodes[node].state) && (0 != nnchain_cluster(nnchain, node, cluster, ctx)))
+            return -1;
+    }
+    for (node = 0; node < nnchain->nb_points; node++) {
+        if ((NNCHAIN_FINAL == nnchain->nodes[node].state) && (0 != nnchain_cluster(nnchain, node, cluster, ctx)))
+            return -1;
+    }
+
+    return 0;
+}
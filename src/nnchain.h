@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef NNCHAIN_H
+#define NNCHAIN_H
+
+typedef struct nnchain_t nnchain_t;
+typedef int (nnchain_cluster_callback_fn_t) (void *ctx, const size_t *points, size_t nb_points);
+
+/**
+ * Make a new complete-linkage clustering of points, driven by a sparse set of
+ * similarities: two clusters are only merged if every pair of their points
+ * was given a similarity, and they are merged most similar first (the
+ * similarity of two clusters is the smallest of their pairs). Runs the
+ * nearest-neighbor chain algorithm, in time and memory linear in the number
+ * of similarities given.
+ * @param nb_points The number of points.
+ * @return Return a pointer to a newly allocated clustering, NULL if an error
+ * occured.
+ */
+nnchain_t *nnchain_make(size_t nb_points);
+
+/**
+ * Deallocate the clustering.
+ * @param nnchain The clustering you are working with.
+ */
+void nnchain_destroy(nnchain_t *nnchain);
+
+/**
+ * Give the similarity of a pair of points, at most once per pair. The pairs
+ * never given are too far apart to ever share a cluster.
+ * @param nnchain The clustering you are working with.
+ * @param point_1 The index of the first point.
+ * @param point_2 The index of the second point.
+ * @param value The similarity.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int nnchain_add(nnchain_t *nnchain, size_t point_1, size_t point_2, float value);
+
+/**
+ * Run the clustering, once every similarity was given.
+ * @param nnchain The clustering you are working with.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int nnchain_run(nnchain_t *nnchain);
+
+/**
+ * Walk the clusters: those of several points first, in the order they were
+ * completed by a merge, then the points left alone, in increasing order.
+ * @param nnchain The clustering you are working with.
+ * @param cluster The function called on each cluster, given ctx, its points
+ * (the points of the first cluster merged, then those of the second) and
+ * their number. It returns 0 to go on, -1 to stop the walk.
+ * @param ctx The context given to cluster.
+ * @return 0 if the walk went through, -1 otherwise.
+ */
+int nnchain_clusters(nnchain_t *nnchain, nnchain_cluster_callback_fn_t *cluster, void *ctx);
+
+#endif /* NNCHAIN_H */
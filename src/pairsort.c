@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "heap.h"
+#include "pairsort.h"
+
+#define PAIRSORT_TEMPLATE "cluster_words.XXXXXX"
+/* Records read (or written) at once from a run in a merge. */
+#define PAIRSORT_MIN_BLOCK 512
+
+/*
+ * Runs are fixed size records, one after the other in a single scratch file
+ * (read and written at explicit offsets), so that any number of runs only
+ * takes one file descriptor. The memory budget is one array of records: a
+ * whole run when pairs are inserted, one block per run (and one for the
+ * output) when runs are merged, the merge heap holding a cursor per run.
+ */
+struct pairsort_record_t {
+    float value;
+    uint32_t word_1, word_2;
+};
+
+struct pairsort_run_t {
+    off_t start;
+    size_t nb_records;
+};
+
+struct pairsort_cursor_t {
+    struct pairsort_record_t *block;
+    size_t block_size, nb_block, pos;
+    /* Records of the run not read yet, and where they are. */
+    off_t next;
+    size_t nb_left;
+};
+
+struct pairsort_t {
+    char *dir;
+    int fd;
+    off_t end;
+    struct pairsort_record_t *records;
+    size_t max_records, nb_records;
+    struct pairsort_run_t *runs;
+    size_t nb_runs, max_runs, nb_written;
+    struct pairsort_cursor_t *cursors;
+    heap_t *heap;
+};
+
+/* Most similar first, then smallest pair first: > 0 when r1 comes first. */
+static inline int pairsort_cmp(const struct pairsort_record_t *r1, const struct pairsort_record_t *r2)
+{
+    if (r1->value != r2->value)
+        return (r1->value > r2->value) ? 1 : -1;
+    if (r1->word_1 != r2->word_1)
+        return (r1->word_1 < r2->word_1) ? 1 : -1;
+
+    return (r1->word_2 < r2->word_2) ? 1 : ((r1->word_2 > r2->word_2) ? -1 : 0);
+}
+
+static int record_cmp(const void *data1, const void *data2)
+{
+    return pairsort_cmp(data2, data1);
+}
+
+static int cursor_cmp(const void *data1, const void *data2)
+{
+    const struct pairsort_cursor_t *c1 = data1;
+    const struct pairsort_cursor_t *c2 = data2;
+
+    return pairsort_cmp(c1->block + c1->pos, c2->block + c2->pos);
+}
+
+/* A scratch file, already removed from dir. */
+static int scratch_open(const char *dir)
+{
+    size_t len = strlen(dir) + sizeof(PAIRSORT_TEMPLATE) + 1;
+    char *path;
+    int fd;
+
+    if (NULL == (path = malloc(len))) {
+        perror("malloc");
+        return -1;
+    }
+    snprintf(path, len, "%s/%s", dir, PAIRSORT_TEMPLATE);
+    if (-1 == (fd = mkstemp(path)))
+        perror(path);
+    else
+        unlink(path);
+    free(path);
+
+    return fd;
+}
+
+static int write_all(int fd, const void *buffer, size_t size, off_t offset)
+{
+    const char *p = buffer;
+    ssize_t written;
+
+    while (size > 0) {
+        if (-1 == (written = pwrite(fd, p, size, offset))) {
+            if (EINTR == errno)
+                continue;
+            perror("pwrite");
+            return -1;
+        }
+        p += written;
+        size -= written;
+        offset += written;
+    }
+
+    return 0;
+}
+
+static int read_all(int fd, void *buffer, size_t size, off_t offset)
+{
+    char *p = buffer;
+    ssize_t nb_read;
+
+    while (size > 0) {
+        if (-1 == (nb_read = pread(fd, p, size, offset))) {
+            if (EINTR == errno)
+                continue;
+            perror("pread");
+            return -1;
+        }
+        if (0 == nb_read) {
+            fprintf(stderr, "pairsort: unexpected end of the scratch file\n");
+            return -1;
+        }
+        p += nb_read;
+        size -= nb_read;
+        offset += nb_read;
+    }
+
+    return 0;
+}
+
+static int run_append(pairsort_t *sort, off_t start, size_t nb_records)
+{
+    struct pairsort_run_t *runs;
+    size_t new_max;
+
+    if (sort->nb_runs == sort->max_runs) {
+        new_max = (0 == sort->max_runs) ? 16 : 2 * sort->max_runs;
+        if (NULL == (runs = realloc(sort->runs, new_max * sizeof(struct pairsort_run_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        sort->runs = runs;
+        sort->max_runs = new_max;
+    }
+    sort->runs[sort->nb_runs].start = start;
+    sort->runs[sort->nb_runs].nb_records = nb_records;
+    sort->nb_runs++;
+    sort->nb_written++;
+
+    return 0;
+}
+
+/* Sort the records inserted and write them as a run. */
+static int run_flush(pairsort_t *sort)
+{
+    size_t size = sort->nb_records * sizeof(struct pairsort_record_t);
+
+    if (0 == sort->nb_records)
+        return 0;
+    qsort(sort->records, sort->nb_records, sizeof(struct pairsort_record_t), record_cmp);
+    if ((0 != write_all(sort->fd, sort->records, size, sort->end)) || (0 != run_append(sort, sort->end, sort->nb_records)))
+        return -1;
+    sort->end += size;
+    sort->nb_records = 0;
+
+    return 0;
+}
+
+static int cursor_fill(const pairsort_t *sort, struct pairsort_cursor_t *cursor)
+{
+    size_t n = (cursor->nb_left < cursor->block_size) ? cursor->nb_left : cursor->block_size;
+
+    if (0 != read_all(sort->fd, cursor->block, n * sizeof(struct pairsort_record_t), cursor->next))
+        return -1;
+    cursor->next += n * sizeof(struct pairsort_record_t);
+    cursor->nb_left -= n;
+    cursor->nb_block = n;
+    cursor->pos = 0;
+
+    return 0;
+}
+
+static void merge_close(pairsort_t *sort)
+{
+    heap_destroy(sort->heap);
+    sort->heap = NULL;
+    free(sort->cursors);
+    sort->cursors = NULL;
+}
+
+/* Start merging runs, each one read by blocks of block_size records from the start of the buffer. */
+static int merge_open(pairsort_t *sort, const struct pairsort_run_t *runs, size_t nb_runs, size_t block_size)
+{
+    struct pairsort_cursor_t *cursor;
+    size_t r;
+
+    sort->heap = heap_make(cursor_cmp, NULL);
+    sort->cursors = calloc(nb_runs + 1, sizeof(struct pairsort_cursor_t));
+    if ((NULL == sort->heap) || (NULL == sort->cursors)) {
+        merge_close(sort);
+        return -1;
+    }
+    for (r = 0; r < nb_runs; r++) {
+        cursor = sort->cursors + r;
+        cursor->block = sort->records + r * block_size;
+        cursor->block_size = block_size;
+        cursor->next = runs[r].start;
+        cursor->nb_left = runs[r].nb_records;
+        if ((0 != cursor_fill(sort, cursor)) || ((cursor->nb_block > 0) && (0 != heap_insert(sort->heap, cursor)))) {
+            merge_close(sort);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int merge_next(pairsort_t *sort, struct pairsort_record_t *record)
+{
+    struct pairsort_cursor_t *cursor;
+
+    if (NULL == (cursor = heap_extract(sort->heap)))
+        return 0;
+    *record = cursor->block[cursor->pos++];
+    if (cursor->pos == cursor->nb_block) {
+        if (0 == cursor->nb_left)
+            return 1;
+        if (0 != cursor_fill(sort, cursor))
+            return -1;
+    }
+    if (0 != heap_insert(sort->heap, cursor))
+        return -1;
+
+    return 1;
+}
+
+/* Merge the runs by groups of fan_in into a new scratch file, until they are fan_in at most. */
+static int merge_pass(pairsort_t *sort, size_t fan_in)
+{
+    struct pairsort_record_t record, *output;
+    size_t g, n, nb_new, nb_output, nb_run, block_size;
+    off_t out_end, start;
+    int out, rv;
+
+    if (-1 == (out = scratch_open(sort->dir)))
+        return -1;
+    for (g = 0, nb_new = 0, out_end = 0; g < sort->nb_runs; g += fan_in) {
+        n = (sort->nb_runs - g < fan_in) ? sort->nb_runs - g : fan_in;
+        block_size = sort->max_records / (n + 1);
+        output = sort->records + n * block_size;
+        if (0 != merge_open(sort, sort->runs + g, n, block_size)) {
+            close(out);
+            return -1;
+        }
+        for (start = out_end, nb_output = nb_run = 0; 1 == (rv = merge_next(sort, &record));) {
+            output[nb_output++] = record;
+            nb_run++;
+            if (nb_output == block_size) {
+                if (0 != write_all(out, output, nb_output * sizeof(struct pairsort_record_t), out_end))
+                    break;
+                out_end += nb_output * sizeof(struct pairsort_record_t);
+                nb_output = 0;
+            }
+        }
+        if ((0 == rv) && (0 != write_all(out, output, nb_output * sizeof(struct pairsort_record_t), out_end)))
+            rv = -1;
+        out_end += nb_output * sizeof(struct pairsort_record_t);
+        merge_close(sort);
+        if (0 != rv) {
+            close(out);
+            return -1;
+        }
+        /* The runs of group g are read already: the new run takes a slot before them. */
+        sort->runs[nb_new].start = start;
+        sort->runs[nb_new].nb_records = nb_run;
+        nb_new++;
+    }
+    close(sort->fd);
+    sort->fd = out;
+    sort->end = out_end;
+    sort->nb_runs = nb_new;
+    sort->nb_written += nb_new;
+
+    return 0;
+}
+
+pairsort_t *pairsort_make(const char *dir, size_t mem_limit)
+{
+    pairsort_t *sort;
+
+    if (mem_limit < PAIRSORT_MIN_MEMORY) {
+        fprintf(stderr, "pairsort: a budget of %zu bytes is below %d\n", mem_limit, PAIRSORT_MIN_MEMORY);
+        return NULL;
+    }
+    if (NULL == (sort = calloc(1, sizeof(pairsort_t))))
+        return NULL;
+    sort->fd = -1;
+    sort->max_records = mem_limit / sizeof(struct pairsort_record_t);
+    sort->dir = strdup(dir);
+    sort->records = malloc(sort->max_records * sizeof(struct pairsort_record_t));
+    if ((NULL == sort->dir) || (NULL == sort->records) || (-1 == (sort->fd = scratch_open(dir)))) {
+        pairsort_destroy(sort);
+        return NULL;
+    }
+
+    return sort;
+}
+
+void pairsort_destroy(pairsort_t *sort)
+{
+    if (NULL != sort) {
+        merge_close(sort);
+        if (-1 != sort->fd)
+            close(sort->fd);
+        free(sort->runs);
+        free(sort->records);
+        free(sort->dir);
+        free(sort);
+    }
+}
+
+int pairsort_insert(pairsort_t *sort, float value, size_t word_1, size_t word_2)
+{
+    struct pairsort_record_t *record;
+
+    if ((sort->nb_records == sort->max_records) && (0 != run_flush(sort)))
+        return -1;
+    record = sort->records + sort->nb_records++;
+    record->value = value;
+    record->word_1 = (uint32_t) word_1;
+    record->word_2 = (uint32_t) word_2;
+
+    return 0;
+}
+
+int pairsort_merge(pairsort_t *sort)
+{
+    /* Each run gets a block of PAIRSORT_MIN_BLOCK records at least, and the output one. */
+    size_t fan_in = sort->max_records / PAIRSORT_MIN_BLOCK - 1;
+
+    if (0 != run_flush(sort))
+        return -1;
+    while (sort->nb_runs > fan_in) {
+        if (0 != merge_pass(sort, fan_in))
+            return -1;
+    }
+
+    return merge_open(sort, sort->runs, sort->nb_runs, sort->max_records / ((0 == sort->nb_runs) ? 1 : sort->nb_runs));
+}
+
+int pairsort_extract(pairsort_t *sort, float *value, size_t *word_1, size_t *word_2)
+{
+    struct pairsort_record_t record;
+    int rv;
+
+    if (1 == (rv = merge_next(sort, &record))) {
+        *value = record.value;
+        *word_1 = record.word_1;
+        *word_2 = record.word_2;
+    }
+
+    return rv;
+}
+
+size_t pairsort_nb_runs(const pairsort_t *sort)
+{
+    return sort->nb_written;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef PAIRSORT_H
+#define PAIRSORT_H
+
+#include <stddef.h>
+
+/* The smallest memory budget of a sort. */
+#define PAIRSORT_MIN_MEMORY (64 * 1024)
+
+typedef struct pairsort_t pairsort_t;
+
+/**
+ * Make a new external sort of pairs of words, giving them back in the order
+ * of bucket_queue: the most similar pair first, and among pairs of equal
+ * similarity the smallest (word_1, word_2). Pairs are sorted in runs as large
+ * as the memory budget, written to a scratch file, then merged back.
+ * @param dir The directory of the scratch files, removed as soon as they are
+ * created (they go away with the process).
+ * @param mem_limit The memory budget of the sort, in bytes, at least
+ * PAIRSORT_MIN_MEMORY.
+ * @return Return a pointer to a newly allocated sort, NULL if an error
+ * occured.
+ */
+pairsort_t *pairsort_make(const char *dir, size_t mem_limit);
+
+/**
+ * Deallocate the sort and close its scratch files.
+ * @param sort The sort you are working with.
+ */
+void pairsort_destroy(pairsort_t *sort);
+
+/**
+ * Insert a pair, before pairsort_merge.
+ * @param sort The sort you are working with.
+ * @param value The similarity of the pair.
+ * @param word_1 The index of the first word (smaller than 2^32).
+ * @param word_2 The index of the second word (smaller than 2^32).
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int pairsort_insert(pairsort_t *sort, float value, size_t word_1, size_t word_2);
+
+/**
+ * Write the last run, and merge runs until the budget can hold a block of
+ * each of them for pairsort_extract.
+ * @param sort The sort you are working with.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int pairsort_merge(pairsort_t *sort);
+
+/**
+ * Extract the next pair, after pairsort_merge.
+ * @param sort The sort you are working with.
+ * @param value Receives the similarity of the pair.
+ * @param word_1 Receives the index of the first word.
+ * @param word_2 Receives the index of the second word.
+ * @return 1 if a pair was extracted, 0 if there is none left, -1 if an error
+ * occured.
+ */
+int pairsort_extract(pairsort_t *sort, float *value, size_t *word_1, size_t *word_2);
+
+/**
+ * Get the number of sorted runs written to the scratch file.
+ * @param sort The sort you are working with.
+ * @return The number of runs, merge passes included.
+ */
+size_t pairsort_nb_runs(const pairsort_t *sort);
+
+#endif /* PAIRSORT_H */
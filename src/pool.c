@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+/*
+ * Slabs are chained through their first bytes, objects follow. Freed objects
+ * are chained through their own first bytes, so an object is at least a
+ * pointer large, and sizes are rounded up to keep every object aligned.
+ */
+struct pool_slab_t {
+    struct pool_slab_t *next;
+};
+
+struct pool_free_t {
+    struct pool_free_t *next;
+};
+
+struct pool_t {
+    size_t object_size, objects_per_slab;
+    struct pool_slab_t *slabs;
+    struct pool_free_t *free_list;
+    /* Objects of the current slab never given yet. */
+    char *fresh;
+    size_t nb_fresh;
+};
+
+#define POOL_ALIGN (sizeof(void *) > sizeof(double) ? sizeof(void *) : sizeof(double))
+#define POOL_ROUND(size) (((size) + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN)
+
+pool_t *pool_make(size_t object_size, size_t objects_per_slab)
+{
+    pool_t *pool;
+
+    if (NULL == (pool = calloc(1, sizeof(pool_t))))
+        return NULL;
+    pool->object_size = POOL_ROUND((object_size < sizeof(struct pool_free_t)) ? sizeof(struct pool_free_t) : object_size);
+    pool->objects_per_slab = (0 == objects_per_slab) ? 1 : objects_per_slab;
+
+    return pool;
+}
+
+void pool_destroy(pool_t *pool)
+{
+    struct pool_slab_t *slab, *next;
+
+    if (NULL != pool) {
+        for (slab = pool->slabs; NULL != slab; slab = next) {
+            next = slab->next;
+            free(slab);
+        }
+        free(pool);
+    }
+}
+
+void *pool_alloc(pool_t *pool)
+{
+    struct pool_slab_t *slab;
+    void *object;
+
+    if (NULL != pool->free_list) {
+        object = pool->free_list;
+        pool->free_list = pool->free_list->next;
+        return object;
+    }
+    if (0 == pool->nb_fresh) {
+        if (NULL == (slab = malloc(POOL_ROUND(sizeof(struct pool_slab_t)) + pool->objects_per_slab * pool->object_size))) {
+            perror("malloc");
+            return NULL;
+        }
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->fresh = (char *) slab + POOL_ROUND(sizeof(struct pool_slab_t));
+        pool->nb_fresh = pool->objects_per_slab;
+    }
+    object = pool->fresh;
+    pool->fresh += pool->object_size;
+    pool->nb_fresh--;
+
+    return object;
+}
+
+void pool_free(pool_t *pool, void *object)
+{
+    struct pool_free_t *freed = object;
+
+    freed->next = pool->free_list;
+    pool->free_list = freed;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef POOL_H
+#define POOL_H
+
+typedef struct pool_t pool_t;
+
+/**
+ * Make a new pool of objects of a given size: objects are carved out of
+ * large slabs, without any per object overhead, and freed objects are
+ * reused. Destroying the pool releases every object at once.
+ * @param object_size The size of an object.
+ * @param objects_per_slab The number of objects of each slab.
+ * @return Return a pointer to a newly allocated pool, NULL if an error
+ * occured.
+ * @remark A pool is not thread safe.
+ */
+pool_t *pool_make(size_t object_size, size_t objects_per_slab);
+
+/**
+ * Deallocate the pool and every object it gave.
+ * @param pool The pool you are working with.
+ */
+void pool_destroy(pool_t *pool);
+
+/**
+ * Get an object.
+ * @param pool The pool you are working with.
+ * @return The object, NULL if an error occured.
+ */
+void *pool_alloc(pool_t *pool);
+
+/**
+ * Give an object back to the pool, for a later pool_alloc.
+ * @param pool The pool you are working with.
+ * @param object An object given by this pool.
+ */
+void pool_free(pool_t *pool, void *object);
+
+#endif /* POOL_H */
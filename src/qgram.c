@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "levenshtein.h"
+#include "qgram.h"
+
+/* Same folding as the distance kernels. */
+#define QGRAM_FOLD(c) ((unsigned char) ((((unsigned char) (c)) >= 'A' && ((unsigned char) (c)) <= 'Z') ? ((c) | 0x20) : (c)))
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#define QGRAM_REJECTED LONG_MAX
+
+/*
+ * Count filter (Ukkonen 1992): an edit touches at most q grams, so two words
+ * within k edits, the longest of length l, share at least l - q + 1 - k * q
+ * grams. A gram of the query word is counted once per candidate holding it
+ * (optionally at a position within k), which can only overestimate the
+ * number of shared grams, never miss a pair.
+ *
+ * Grams (at most QGRAM_MAX_Q folded characters) are packed in a 64 bits key.
+ * The postings of each gram are sorted by word, so the words following the
+ * query one are found by a binary search, and the words being sorted by
+ * length, the words of a given length are a contiguous range too.
+ */
+struct qgram_posting_t {
+    uint32_t word;
+    uint32_t pos;
+};
+
+struct qgram_entry_t {
+    uint64_t key;
+    uint32_t word;
+    uint32_t pos;
+};
+
+struct qgram_index_t {
+    size_t q;
+    int positional;
+    size_t nb_words;
+    const size_t *lens;
+    size_t max_len;
+    /* Words of length l are [len_first[l], len_first[l + 1]). */
+    size_t *len_first;
+    /* Posting list of each gram of word w in grams[word_first[w], word_first[w + 1]). */
+    size_t *word_first;
+    uint32_t *grams;
+    /* Postings of list g are postings[list_first[g], list_first[g + 1]). */
+    size_t *list_first;
+    struct qgram_posting_t *postings;
+};
+
+/* qgram_candidates work area, one per thread. */
+struct qgram_search_t {
+    uint32_t *counts;
+    size_t *touched;
+    long *max_edits;
+    long *min_common;
+};
+
+static int qgram_entry_cmp(const void *data1, const void *data2)
+{
+    const struct qgram_entry_t *e1 = data1;
+    const struct qgram_entry_t *e2 = data2;
+
+    if (e1->key != e2->key)
+        return (e1->key < e2->key) ? -1 : 1;
+    if (e1->word != e2->word)
+        return (e1->word < e2->word) ? -1 : 1;
+
+    return (e1->pos < e2->pos) ? -1 : ((e1->pos > e2->pos) ? 1 : 0);
+}
+
+static int qgram_word_cmp(const void *data1, const void *data2)
+{
+    size_t w1 = *(const size_t *) data1;
+    size_t w2 = *(const size_t *) data2;
+
+    return (w1 < w2) ? -1 : ((w1 > w2) ? 1 : 0);
+}
+
+void qgram_index_destroy(qgram_index_t *index)
+{
+    if (NULL != index) {
+        free(index->len_first);
+        free(index->word_first);
+        free(index->grams);
+        free(index->list_first);
+        free(index->postings);
+        free(index);
+    }
+}
+
+qgram_index_t *qgram_index_make(const char * const *words, const size_t *lens, size_t nb_words, size_t q, int positional)
+{
+    qgram_index_t *index;
+    struct qgram_entry_t *entries;
+    uint64_t key, mask;
+    size_t w, i, l, nb_grams, nb_lists;
+
+    if ((q < 1) || (q > QGRAM_MAX_Q)) {
+        fprintf(stderr, "q-gram length must be between 1 and %d\n", QGRAM_MAX_Q);
+        return NULL;
+    }
+    if (nb_words >= UINT32_MAX) {
+        fprintf(stderr, "too many words for the q-gram index: %zu\n", nb_words);
+        return NULL;
+    }
+
+    if (NULL == (index = calloc(1, sizeof(struct qgram_index_t))))
+        return NULL;
+    index->q = q;
+    index->positional = positional;
+    index->nb_words = nb_words;
+    index->lens = lens;
+    for (w = 0, nb_grams = 0; w < nb_words; w++) {
+        index->max_len = (lens[w] > index->max_len) ? lens[w] : index->max_len;
+        nb_grams += (lens[w] >= q) ? lens[w] - q + 1 : 0;
+    }
+
+    index->len_first = calloc(index->max_len + 2, sizeof(size_t));
+    index->word_first = malloc((nb_words + 1) * sizeof(size_t));
+    index->grams = malloc((nb_grams + 1) * sizeof(uint32_t));
+    index->postings = malloc((nb_grams + 1) * sizeof(struct qgram_posting_t));
+    entries = malloc((nb_grams + 1) * sizeof(struct qgram_entry_t));
+    if ((NULL == index->len_first) || (NULL == index->word_first) || (NULL == index->grams) || (NULL == index->postings)
+        || (NULL == entries)) {
+        free(entries);
+        qgram_index_destroy(index);
+        return NULL;
+    }
+
+    for (w = 0; w < nb_words; w++)
+        index->len_first[lens[w] + 1]++;
+    for (l = 1; l <= index->max_len + 1; l++)
+        index->len_first[l] += index->len_first[l - 1];
+
+    mask = (QGRAM_MAX_Q == q) ? ~((uint64_t) 0) : ((((uint64_t) 1) << (8 * q)) - 1);
+    for (w = 0, nb_grams = 0; w < nb_words; w++) {
+        index->word_first[w] = nb_grams;
+        for (i = 0, key = 0; i < lens[w]; i++) {
+            key = ((key << 8) | QGRAM_FOLD(words[w][i])) & mask;
+            if (i + 1 >= q) {
+                entries[nb_grams].key = key;
+                entries[nb_grams].word = w;
+                entries[nb_grams].pos = i + 1 - q;
+                nb_grams++;
+            }
+        }
+    }
+    index->word_first[nb_words] = nb_grams;
+
+    qsort(entries, nb_grams, sizeof(struct qgram_entry_t), qgram_entry_cmp);
+    for (i = 0, nb_lists = 0; i < nb_grams; i++)
+        nb_lists += ((0 == i) || (entries[i].key != entries[i - 1].key));
+    if (NULL == (index->list_first = malloc((nb_lists + 1) * sizeof(size_t)))) {
+        free(entries);
+        qgram_index_destroy(index);
+        return NULL;
+    }
+    for (i = 0, nb_lists = 0; i < nb_grams; i++) {
+        if ((0 == i) || (entries[i].key != entries[i - 1].key))
+            index->list_first[nb_lists++] = i;
+        index->postings[i].word = entries[i].word;
+        index->postings[i].pos = entries[i].pos;
+        index->grams[index->word_first[entries[i].word] + entries[i].pos] = nb_lists - 1;
+    }
+    index->list_first[nb_lists] = nb_grams;
+    free(entries);
+
+    return index;
+}
+
+qgram_search_t *qgram_search_make(const qgram_index_t *index)
+{
+    qgram_search_t *search;
+
+    if (NULL == (search = calloc(1, sizeof(struct qgram_search_t))))
+        return NULL;
+    search->counts = calloc(index->nb_words + 1, sizeof(uint32_t));
+    search->touched = malloc((index->nb_words + 1) * sizeof(size_t));
+    search->max_edits = malloc((index->max_len + 1) * sizeof(long));
+    search->min_common = malloc((index->max_len + 1) * sizeof(long));
+    if ((NULL == search->counts) || (NULL == search->touched) || (NULL == search->max_edits) || (NULL == search->min_common)) {
+        qgram_search_destroy(search);
+        return NULL;
+    }
+
+    return search;
+}
+
+void qgram_search_destroy(qgram_search_t *search)
+{
+    if (NULL != search) {
+        free(search->counts);
+        free(search->touched);
+        free(search->max_edits);
+        free(search->min_common);
+        free(search);
+    }
+}
+
+size_t qgram_candidates(const qgram_index_t *index, qgram_search_t *search, size_t word, size_t end, float cutoff, size_t *candidates)
+{
+    const size_t *lens = index->lens;
+    const struct qgram_posting_t *post, *post_end;
+    size_t l1, l2, last_len, g, j, k, last, nb, nb_touched, lo, hi;
+    long shift;
+
+    if (end <= word + 1)
+        return 0;
+
+    /* Edits allowed and grams needed for each candidate length. */
+    l1 = lens[word];
+    last_len = lens[end - 1];
+    for (l2 = l1; l2 <= last_len; l2++) {
+        k = levenshtein_max_edits(l1, l2, cutoff);
+        if (k < l2 - l1) {
+            search->min_common[l2] = QGRAM_REJECTED;
+            continue;
+        }
+        search->max_edits[l2] = k;
+        search->min_common[l2] = (long) l2 - (long) index->q + 1 - (long) (k * index->q);
+    }
+
+    nb_touched = 0;
+    for (g = index->word_first[word]; g < index->word_first[word + 1]; g++) {
+        post = index->postings + index->list_first[index->grams[g]];
+        post_end = index->postings + index->list_first[index->grams[g] + 1];
+        /* First posting of a word after the query one. */
+        for (lo = 0, hi = post_end - post; lo < hi;) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (post[mid].word <= word)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (post += lo, last = SIZE_MAX; (post < post_end) && (post->word < end); post++) {
+            j = post->word;
+            l2 = lens[j];
+            if ((j == last) || (search->min_common[l2] <= 0) || (QGRAM_REJECTED == search->min_common[l2]))
+                continue;
+            if (index->positional) {
+                shift = (long) (g - index->word_first[word]) - (long) post->pos;
+                if ((shift > search->max_edits[l2]) || (-shift > search->max_edits[l2]))
+                    continue;
+            }
+            last = j;
+            if (0 == search->counts[j]++)
+                search->touched[nb_touched++] = j;
+        }
+    }
+
+    for (g = 0, nb = 0; g < nb_touched; g++) {
+        j = search->touched[g];
+        if (search->counts[j] >= search->min_common[lens[j]])
+            candidates[nb++] = j;
+        search->counts[j] = 0;
+    }
+    /* Lengths the filter can't tell anything about: every word is a candidate. */
+    for (l2 = l1; l2 <= last_len; l2++) {
+        if (search->min_common[l2] > 0)
+            continue;
+        for (j = (index->len_first[l2] > word) ? index->len_first[l2] : word + 1; j < MIN(end, index->len_first[l2 + 1]); j++)
+            candidates[nb++] = j;
+    }
+    qsort(candidates, nb, sizeof(size_t), qgram_word_cmp);
+
+    return nb;
+}
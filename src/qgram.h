@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef QGRAM_H
+#define QGRAM_H
+
+#define QGRAM_MAX_Q 8
+
+typedef struct qgram_index_t qgram_index_t;
+typedef struct qgram_search_t qgram_search_t;
+
+/**
+ * Make an inverted index of the (case folded) q-grams of a set of words, used
+ * to find the words that may be similar to a given one without comparing it
+ * to all the others.
+ * @param words The words, sorted by increasing length.
+ * @param lens The length of each word, this array must outlive the index.
+ * @param nb_words The number of words.
+ * @param q The length of the grams, from 1 to QGRAM_MAX_Q.
+ * @param positional If set, two grams only match when their positions differ
+ * by no more than the number of edits allowed to the pair of words.
+ * @return Return a pointer to a newly allocated index, NULL if an error
+ * occured.
+ */
+qgram_index_t *qgram_index_make(const char * const *words, const size_t *lens, size_t nb_words, size_t q, int positional);
+
+/**
+ * Deallocate the index.
+ * @param index The index you are working with.
+ */
+void qgram_index_destroy(qgram_index_t *index);
+
+/**
+ * Make the work area of qgram_candidates, each thread searching the index
+ * needs its own.
+ * @param index The index you are working with.
+ * @return Return a pointer to a newly allocated work area, NULL if an error
+ * occured.
+ */
+qgram_search_t *qgram_search_make(const qgram_index_t *index);
+
+/**
+ * Deallocate a work area.
+ * @param search The work area you are working with.
+ */
+void qgram_search_destroy(qgram_search_t *search);
+
+/**
+ * Get the words that may reach a similarity with a given word: those among
+ * the words following it, up to end, that share enough q-grams with it to
+ * be within levenshtein_max_edits of it (count filter). The other pairs are
+ * certainly below the cutoff.
+ * @param index The index you are working with.
+ * @param search The work area of the calling thread.
+ * @param word The index of the word.
+ * @param end The index after the last word to consider.
+ * @param cutoff The minimum similarity.
+ * @param candidates Receives the indexes of the candidates, in increasing
+ * order, it must have room for end - word - 1 entries.
+ * @return The number of candidates.
+ */
+size_t qgram_candidates(const qgram_index_t *index, qgram_search_t *search, size_t word, size_t end, float cutoff, size_t *candidates);
+
+#endif /* QGRAM_H */
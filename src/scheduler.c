@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+/*
+ * Without a window, thread t starts with tasks t, t + n, t + 2n... in its
+ * deque: it pops them from the head, thieves take from the tail. No task is
+ * ever added, so a thread finding every deque empty is done. Deques are short
+ * lived and only touched once per task, a mutex each is enough. With a
+ * window, tasks start in order, so there are no deques: a thread takes the
+ * next task under the mutex of the scheduler, which it locks anyway to check
+ * the window, and waits for the consumer to move on when it is beyond.
+ */
+#define SCHEDULER_PENDING 0
+#define SCHEDULER_DONE 1
+#define SCHEDULER_FAILED (-1)
+
+struct scheduler_deque_t {
+    pthread_mutex_t mutex;
+    size_t *tasks;
+    size_t head, tail;
+};
+
+struct scheduler_worker_t {
+    scheduler_t *scheduler;
+    size_t id;
+    pthread_t thread;
+    int started;
+};
+
+struct scheduler_t {
+    scheduler_task_callback_fn_t *task;
+    void *ctx;
+    size_t nb_threads, nb_tasks;
+    struct scheduler_deque_t *deques;
+    struct scheduler_worker_t *workers;
+    /* Protects status and consumed, signaled on each completion and each wait. */
+    pthread_mutex_t mutex;
+    pthread_cond_t done, advance;
+    signed char *status;
+    /* Tasks from consumed to consumed + window - 1 may start, every one if window is 0. */
+    size_t consumed, window;
+    /* Without threads or with a window: next task to run. */
+    size_t next;
+};
+
+static int scheduler_steal(scheduler_t *scheduler, size_t id, size_t *task)
+{
+    struct scheduler_deque_t *deque;
+    size_t v;
+    int found;
+
+    for (v = 0, found = 0; (v < scheduler->nb_threads) && !found; v++) {
+        deque = scheduler->deques + (id + v) % scheduler->nb_threads;
+        pthread_mutex_lock(&deque->mutex);
+        if (deque->head < deque->tail) {
+            /* Own deque: lowest task first; someone else's: highest first. */
+            *task = (0 == v) ? deque->tasks[deque->head++] : deque->tasks[--deque->tail];
+            found = 1;
+        }
+        pthread_mutex_unlock(&deque->mutex);
+    }
+
+    return found;
+}
+
+static int scheduler_take(scheduler_t *scheduler, size_t id, size_t *task)
+{
+    int found;
+
+    if (0 == scheduler->window)
+        return scheduler_steal(scheduler, id, task);
+    pthread_mutex_lock(&scheduler->mutex);
+    /* Every task left may be beyond the window: wait for the consumer to move on. */
+    while ((scheduler->next < scheduler->nb_tasks) && (scheduler->next >= scheduler->consumed + scheduler->window))
+        pthread_cond_wait(&scheduler->advance, &scheduler->mutex);
+    found = (scheduler->next < scheduler->nb_tasks);
+    if (found)
+        *task = scheduler->next++;
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return found;
+}
+
+static void scheduler_complete(scheduler_t *scheduler, size_t task, int rv)
+{
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->status[task] = (0 == rv) ? SCHEDULER_DONE : SCHEDULER_FAILED;
+    pthread_cond_broadcast(&scheduler->done);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+static void *scheduler_worker(void *data)
+{
+    struct scheduler_worker_t *worker = data;
+    scheduler_t *scheduler = worker->scheduler;
+    size_t task;
+
+    while (scheduler_take(scheduler, worker->id, &task))
+        scheduler_complete(scheduler, task, scheduler->task(scheduler->ctx, worker->id, task));
+
+    return NULL;
+}
+
+static void scheduler_free(scheduler_t *scheduler)
+{
+    size_t t;
+
+    if (NULL != scheduler->deques) {
+        for (t = 0; t < scheduler->nb_threads; t++) {
+            pthread_mutex_destroy(&scheduler->deques[t].mutex);
+            free(scheduler->deques[t].tasks);
+        }
+    }
+    free(scheduler->deques);
+    free(scheduler->workers);
+    free(scheduler->status);
+    pthread_mutex_destroy(&scheduler->mutex);
+    pthread_cond_destroy(&scheduler->done);
+    pthread_cond_destroy(&scheduler->advance);
+    free(scheduler);
+}
+
+scheduler_t *scheduler_start(size_t nb_threads, size_t nb_tasks, size_t window, scheduler_task_callback_fn_t *task, void *ctx)
+{
+    scheduler_t *scheduler;
+    size_t t, k;
+
+    if (NULL == (scheduler = calloc(1, sizeof(scheduler_t))))
+        return NULL;
+    scheduler->task = task;
+    scheduler->ctx = ctx;
+    scheduler->nb_tasks = nb_tasks;
+    scheduler->window = window;
+    scheduler->nb_threads = (nb_threads > 1) ? nb_threads : 0;
+    pthread_mutex_init(&scheduler->mutex, NULL);
+    pthread_cond_init(&scheduler->done, NULL);
+    pthread_cond_init(&scheduler->advance, NULL);
+    if (NULL == (scheduler->status = calloc(nb_tasks + 1, sizeof(signed char)))) {
+        scheduler_free(scheduler);
+        return NULL;
+    }
+    if (0 == scheduler->nb_threads)
+        return scheduler;
+
+    scheduler->workers = calloc(scheduler->nb_threads, sizeof(struct scheduler_worker_t));
+    if ((NULL == scheduler->workers)
+        || ((0 == window) && (NULL == (scheduler->deques = calloc(scheduler->nb_threads, sizeof(struct scheduler_deque_t)))))) {
+        scheduler_free(scheduler);
+        return NULL;
+    }
+    for (t = 0; (0 == window) && (t < scheduler->nb_threads); t++) {
+        pthread_mutex_init(&scheduler->deques[t].mutex, NULL);
+        scheduler->deques[t].tasks = malloc((nb_tasks / scheduler->nb_threads + 1) * sizeof(size_t));
+        if (NULL == scheduler->deques[t].tasks) {
+            scheduler_free(scheduler);
+            return NULL;
+        }
+        for (k = t; k < nb_tasks; k += scheduler->nb_threads)
+            scheduler->deques[t].tasks[scheduler->deques[t].tail++] = k;
+    }
+    for (t = 0; t < scheduler->nb_threads; t++) {
+        scheduler->workers[t].scheduler = scheduler;
+        scheduler->workers[t].id = t;
+        if (0 != pthread_create(&scheduler->workers[t].thread, NULL, scheduler_worker, scheduler->workers + t)) {
+            perror("pthread_create");
+            /* The threads already running drain the tasks on their own. */
+            break;
+        }
+        scheduler->workers[t].started = 1;
+    }
+    if (0 == t) {
+        scheduler_free(scheduler);
+        return NULL;
+    }
+
+    return scheduler;
+}
+
+int scheduler_wait(scheduler_t *scheduler, size_t task)
+{
+    int status;
+
+    if (0 == scheduler->nb_threads) {
+        for (; scheduler->next <= task; scheduler->next++) {
+            int rv = scheduler->task(scheduler->ctx, 0, scheduler->next);
+            scheduler->status[scheduler->next] = (0 == rv) ? SCHEDULER_DONE : SCHEDULER_FAILED;
+        }
+        return (SCHEDULER_DONE == scheduler->status[task]) ? 0 : -1;
+    }
+
+    pthread_mutex_lock(&scheduler->mutex);
+    if (task > scheduler->consumed) {
+        scheduler->consumed = task;
+        pthread_cond_broadcast(&scheduler->advance);
+    }
+    while (SCHEDULER_PENDING == scheduler->status[task])
+        pthread_cond_wait(&scheduler->done, &scheduler->mutex);
+    status = scheduler->status[task];
+    pthread_mutex_unlock(&scheduler->mutex);
+
+    return (SCHEDULER_DONE == status) ? 0 : -1;
+}
+
+int scheduler_join(scheduler_t *scheduler)
+{
+    size_t t;
+    int rv = 0;
+
+    for (t = 0; t < scheduler->nb_tasks; t++) {
+        if (0 != scheduler_wait(scheduler, t))
+            rv = -1;
+    }
+    for (t = 0; t < scheduler->nb_threads; t++) {
+        if (scheduler->workers[t].started)
+            pthread_join(scheduler->workers[t].thread, NULL);
+    }
+    scheduler_free(scheduler);
+
+    return rv;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+typedef struct scheduler_t scheduler_t;
+typedef int (scheduler_task_callback_fn_t) (void *ctx, size_t thread, size_t task);
+
+/**
+ * Start running nb_tasks independent tasks, numbered from 0, on a pool of
+ * threads. Without a window, each thread has its own deque of tasks, taken in
+ * increasing order, and steals from the far end of the others' deques once
+ * its own is empty, so tasks of uneven cost keep every thread busy while the
+ * tasks still complete roughly in order. With a window, the threads take the
+ * tasks one after the other from a shared counter, and only window tasks
+ * ahead of the last one waited for: the results a consumer reading them in
+ * order has to hold stay bounded.
+ * @param nb_threads The number of threads, with 0 or 1 no thread is created:
+ * tasks run in the calling thread, from scheduler_wait.
+ * @param nb_tasks The number of tasks.
+ * @param window The number of tasks which may start from the last one waited
+ * for on, 0 for no limit.
+ * @param task The function running a task, given ctx, the number of the
+ * thread (from 0 to nb_threads - 1) and the number of the task. It returns 0
+ * if no error occured, -1 otherwise.
+ * @param ctx The context given to task.
+ * @return Return a pointer to a newly allocated scheduler, NULL if an error
+ * occured.
+ */
+scheduler_t *scheduler_start(size_t nb_threads, size_t nb_tasks, size_t window, scheduler_task_callback_fn_t *task, void *ctx);
+
+/**
+ * Wait for the completion of a task, the tasks before it being consumed.
+ * @param scheduler The scheduler you are working with.
+ * @param task The number of the task.
+ * @return 0 if the task succeeded, -1 otherwise.
+ */
+int scheduler_wait(scheduler_t *scheduler, size_t task);
+
+/**
+ * Wait for the completion of every task, stop the threads and deallocate the
+ * scheduler.
+ * @param scheduler The scheduler you are working with.
+ * @return 0 if every task succeeded, -1 otherwise.
+ */
+int scheduler_join(scheduler_t *scheduler);
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "shard.h"
+
+/* "CWSH", read back swapped on a machine of the other byte order. */
+#define SHARD_MAGIC 0x43575348
+#define SHARD_VERSION 2
+#define SHARD_TEMPLATE ".XXXXXX"
+/* Buffer of the shard file stream: a merge reads every shard at once. */
+#define SHARD_BUFFER (1 << 16)
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/*
+ * A shard file is a header, then for each tile of the shard, in increasing
+ * order, its counters followed by its pairs. Fields are fixed size in the
+ * byte order of the machine, which the magic checks: shards are meant to be
+ * merged on the machines (or the kind of machines) which computed them.
+ */
+struct shard_header_t {
+    uint32_t magic, version;
+    uint64_t shard, nb_shards, nb_words, tile_rows, words_hash;
+    float cutoff;
+    uint32_t qgram, positional, bktree, bands, rows;
+};
+
+struct shard_tile_header_t {
+    uint64_t tile, nb_pairs, nb_pruned, nb_filtered, nb_below;
+};
+
+struct shard_record_t {
+    uint32_t word_1, word_2;
+    float value;
+};
+
+struct shard_t {
+    FILE *file;
+    char *dir, *path, *tmp_path;
+    char *buffer;
+    int created;
+    /* Pairs of the current tile not written (or read) yet. */
+    size_t nb_left;
+};
+
+uint64_t shard_words_hash(const char * const *words, const size_t *lens, size_t nb_words)
+{
+    uint64_t hash = FNV_OFFSET;
+    size_t w, c;
+
+    for (w = 0; w < nb_words; w++) {
+        for (c = 0; c < lens[w]; c++)
+            hash = (hash ^ (unsigned char) words[w][c]) * FNV_PRIME;
+        /* The length tells where a word ends. */
+        for (c = 0; c < sizeof(uint64_t); c++)
+            hash = (hash ^ (((uint64_t) lens[w] >> (8 * c)) & 0xff)) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/* The options of a filter, as given on the command line. */
+static void shard_filter_name(char *name, size_t size, size_t qgram, int positional, int bktree, size_t bands, size_t rows)
+{
+    if (0 != qgram)
+        snprintf(name, size, "-q %zu%s", qgram, positional ? " -p" : "");
+    else if (bktree)
+        snprintf(name, size, "-b");
+    else if (0 != bands)
+        snprintf(name, size, "--lsh %zux%zu", bands, rows);
+    else
+        snprintf(name, size, "no filter");
+}
+
+static void shard_free(shard_t *shard)
+{
+    free(shard->dir);
+    free(shard->path);
+    free(shard->tmp_path);
+    free(shard->buffer);
+    free(shard);
+}
+
+static shard_t *shard_alloc(const char *dir, const shard_info_t *info)
+{
+    shard_t *shard;
+    size_t len;
+
+    if (NULL == (shard = calloc(1, sizeof(shard_t)))) {
+        perror("calloc");
+        return NULL;
+    }
+    len = strlen(dir) + 64;
+    shard->dir = strdup(dir);
+    shard->path = malloc(len);
+    shard->tmp_path = malloc(len + sizeof(SHARD_TEMPLATE));
+    shard->buffer = malloc(SHARD_BUFFER);
+    if ((NULL == shard->dir) || (NULL == shard->path) || (NULL == shard->tmp_path) || (NULL == shard->buffer)) {
+        perror("malloc");
+        shard_free(shard);
+        return NULL;
+    }
+    snprintf(shard->path, len, "%s/shard-%zu-of-%zu.pairs", dir, info->shard, info->nb_shards);
+    snprintf(shard->tmp_path, len + sizeof(SHARD_TEMPLATE), "%s%s", shard->path, SHARD_TEMPLATE);
+
+    return shard;
+}
+
+shard_t *shard_create(const char *dir, const shard_info_t *info)
+{
+    struct shard_header_t header;
+    shard_t *shard;
+    int fd;
+
+    if (NULL == (shard = shard_alloc(dir, info)))
+        return NULL;
+    /* A unique temporary name: a retried shard may still be running somewhere. */
+    if (-1 == (fd = mkstemp(shard->tmp_path))) {
+        perror(shard->tmp_path);
+        shard_free(shard);
+        return NULL;
+    }
+    /* The shards may be merged by another user of the shared storage. */
+    fchmod(fd, 0644);
+    if (NULL == (shard->file = fdopen(fd, "wb"))) {
+        perror(shard->tmp_path);
+        close(fd);
+        unlink(shard->tmp_path);
+        shard_free(shard);
+        return NULL;
+    }
+    shard->created = 1;
+    setvbuf(shard->file, shard->buffer, _IOFBF, SHARD_BUFFER);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SHARD_MAGIC;
+    header.version = SHARD_VERSION;
+    header.shard = info->shard;
+    header.nb_shards = info->nb_shards;
+    header.nb_words = info->nb_words;
+    header.tile_rows = info->tile_rows;
+    header.words_hash = info->words_hash;
+    header.cutoff = info->cutoff;
+    header.qgram = (uint32_t) info->qgram;
+    header.positional = (uint32_t) info->positional;
+    header.bktree = (uint32_t) info->bktree;
+    header.bands = (uint32_t) info->bands;
+    header.rows = (uint32_t) info->rows;
+    if (1 != fwrite(&header, sizeof(header), 1, shard->file)) {
+        perror(shard->tmp_path);
+        shard_close(shard);
+        return NULL;
+    }
+
+    return shard;
+}
+
+int shard_write_tile(shard_t *shard, const shard_tile_t *tile)
+{
+    struct shard_tile_header_t header;
+
+    if (0 != shard->nb_left) {
+        fprintf(stderr, "shard: %zu pairs missing from the previous tile\n", shard->nb_left);
+        return -1;
+    }
+    header.tile = tile->tile;
+    header.nb_pairs = tile->nb_pairs;
+    header.nb_pruned = tile->nb_pruned;
+    header.nb_filtered = tile->nb_filtered;
+    header.nb_below = tile->nb_below;
+    if (1 != fwrite(&header, sizeof(header), 1, shard->file)) {
+        perror(shard->tmp_path);
+        return -1;
+    }
+    shard->nb_left = tile->nb_pairs;
+
+    return 0;
+}
+
+int shard_write_pair(shard_t *shard, float value, size_t word_1, size_t word_2)
+{
+    struct shard_record_t record;
+
+    if (0 == shard->nb_left) {
+        fprintf(stderr, "shard: more pairs than announced by the tile\n");
+        return -1;
+    }
+    record.word_1 = (uint32_t) word_1;
+    record.word_2 = (uint32_t) word_2;
+    record.value = value;
+    if (1 != fwrite(&record, sizeof(record), 1, shard->file)) {
+        perror(shard->tmp_path);
+        return -1;
+    }
+    shard->nb_left--;
+
+    return 0;
+}
+
+int shard_commit(shard_t *shard)
+{
+    int fd, rv = 0;
+
+    if (0 != shard->nb_left) {
+        fprintf(stderr, "shard: %zu pairs missing from the last tile\n", shard->nb_left);
+        rv = -1;
+    }
+    /* The data reaches the disk before the name: a shard file is always whole. */
+    else if ((0 != fflush(shard->file)) || (0 != fsync(fileno(shard->file)))) {
+        perror(shard->tmp_path);
+        rv = -1;
+    }
+    if (0 != fclose(shard->file)) {
+        perror(shard->tmp_path);
+        rv = -1;
+    }
+    shard->file = NULL;
+    if ((0 == rv) && (0 != rename(shard->tmp_path, shard->path))) {
+        perror(shard->path);
+        rv = -1;
+    }
+    if (0 != rv) {
+        unlink(shard->tmp_path);
+    }
+    else if (-1 != (fd = open(shard->dir, O_RDONLY))) {
+        /* And the name reaches the disk too. */
+        fsync(fd);
+        close(fd);
+    }
+    shard_free(shard);
+
+    return rv;
+}
+
+shard_t *shard_open(const char *dir, const shard_info_t *info)
+{
+    struct shard_header_t header;
+    shard_t *shard;
+    char found[64], expected[64];
+
+    if (NULL == (shard = shard_alloc(dir, info)))
+        return NULL;
+    if (NULL == (shard->file = fopen(shard->path, "rb"))) {
+        perror(shard->path);
+        shard_free(shard);
+        return NULL;
+    }
+    setvbuf(shard->file, shard->buffer, _IOFBF, SHARD_BUFFER);
+    if (1 != fread(&header, sizeof(header), 1, shard->file)) {
+        fprintf(stderr, "%s: truncated shard header\n", shard->path);
+        shard_close(shard);
+        return NULL;
+    }
+    if ((SHARD_MAGIC != header.magic) || (SHARD_VERSION != header.version)) {
+        fprintf(stderr, "%s: not a shard file of this version and byte order\n", shard->path);
+        shard_close(shard);
+        return NULL;
+    }
+    if ((header.shard != info->shard) || (header.nb_shards != info->nb_shards) || (header.tile_rows != info->tile_rows)) {
+        fprintf(stderr, "%s: shard %llu of %llu by tiles of %llu words, expected %zu of %zu by %zu\n", shard->path,
+                (unsigned long long) header.shard, (unsigned long long) header.nb_shards, (unsigned long long) header.tile_rows,
+                info->shard, info->nb_shards, info->tile_rows);
+        shard_close(shard);
+        return NULL;
+    }
+    if ((header.nb_words != info->nb_words) || (header.words_hash != info->words_hash)) {
+        fprintf(stderr, "%s: computed from other words (%llu distinct), not those of this file (%zu)\n", shard->path,
+                (unsigned long long) header.nb_words, info->nb_words);
+        shard_close(shard);
+        return NULL;
+    }
+    if (header.cutoff != info->cutoff) {
+        fprintf(stderr, "%s: computed with cutoff %g, not %g\n", shard->path, header.cutoff, info->cutoff);
+        shard_close(shard);
+        return NULL;
+    }
+    if ((header.qgram != info->qgram) || (header.positional != (uint32_t) info->positional)
+        || (header.bktree != (uint32_t) info->bktree) || (header.bands != info->bands) || (header.rows != info->rows)) {
+        shard_filter_name(found, sizeof(found), header.qgram, header.positional, header.bktree, header.bands, header.rows);
+        shard_filter_name(expected, sizeof(expected), info->qgram, info->positional, info->bktree, info->bands, info->rows);
+        fprintf(stderr, "%s: computed with %s, not with %s\n", shard->path, found, expected);
+        shard_close(shard);
+        return NULL;
+    }
+
+    return shard;
+}
+
+int shard_read_tile(shard_t *shard, shard_tile_t *tile)
+{
+    struct shard_tile_header_t header;
+
+    if (0 != shard->nb_left) {
+        fprintf(stderr, "%s: %zu pairs of the previous tile not read\n", shard->path, shard->nb_left);
+        return -1;
+    }
+    if (1 != fread(&header, sizeof(header), 1, shard->file)) {
+        fprintf(stderr, "%s: truncated shard, a tile is missing\n", shard->path);
+        return -1;
+    }
+    tile->tile = header.tile;
+    tile->nb_pairs = header.nb_pairs;
+    tile->nb_pruned = header.nb_pruned;
+    tile->nb_filtered = header.nb_filtered;
+    tile->nb_below = header.nb_below;
+    shard->nb_left = tile->nb_pairs;
+
+    return 0;
+}
+
+int shard_read_pair(shard_t *shard, float *value, size_t *word_1, size_t *word_2)
+{
+    struct shard_record_t record;
+
+    if (0 == shard->nb_left) {
+        fprintf(stderr, "%s: no pair left in the tile\n", shard->path);
+        return -1;
+    }
+    if (1 != fread(&record, sizeof(record), 1, shard->file)) {
+        fprintf(stderr, "%s: truncated shard, a pair is missing\n", shard->path);
+        return -1;
+    }
+    *value = record.value;
+    *word_1 = record.word_1;
+    *word_2 = record.word_2;
+    shard->nb_left--;
+
+    return 0;
+}
+
+void shard_close(shard_t *shard)
+{
+    if (NULL == shard)
+        return;
+    if (NULL != shard->file) {
+        fclose(shard->file);
+        /* Created and not committed: never give it a name. */
+        if (shard->created)
+            unlink(shard->tmp_path);
+    }
+    shard_free(shard);
+}
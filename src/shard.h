@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct shard_t shard_t;
+
+/*
+ * What a shard file is computed from: a shard can only be merged with the
+ * shards of the same words (in the same order), cutoff, filter and tiles.
+ */
+struct shard_info_t {
+    size_t shard, nb_shards;
+    size_t nb_words, tile_rows;
+    uint64_t words_hash;
+    float cutoff;
+    /* Filter of the pairs: q-gram length (0 for none), BK-tree, MinHash bands (0 for none). */
+    size_t qgram;
+    int positional, bktree;
+    size_t bands, rows;
+};
+typedef struct shard_info_t shard_info_t;
+
+/* Counters of a tile of a shard. */
+struct shard_tile_t {
+    size_t tile, nb_pairs, nb_pruned, nb_filtered, nb_below;
+};
+typedef struct shard_tile_t shard_tile_t;
+
+/**
+ * Hash a list of words, to check that shards come from the same one.
+ * @param words The words.
+ * @param lens The length of each word.
+ * @param nb_words The number of words.
+ * @return The hash of the words and of their order.
+ */
+uint64_t shard_words_hash(const char * const *words, const size_t *lens, size_t nb_words);
+
+/**
+ * Create the file of a shard, dir/shard-<shard>-of-<nb_shards>.pairs. It is
+ * written under a temporary name, and only gets its name once committed: a
+ * shard which did not complete leaves no shard file.
+ * @param dir The directory of the shard files.
+ * @param info What the shard is computed from.
+ * @return Return a pointer to a newly allocated shard, NULL if an error
+ * occured.
+ */
+shard_t *shard_create(const char *dir, const shard_info_t *info);
+
+/**
+ * Write the counters of the next tile, followed by its nb_pairs pairs.
+ * @param shard The shard you are working with, created.
+ * @param tile The counters of the tile.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int shard_write_tile(shard_t *shard, const shard_tile_t *tile);
+
+/**
+ * Write a pair of the current tile.
+ * @param shard The shard you are working with, created.
+ * @param value The similarity of the pair.
+ * @param word_1 The index of the first word (smaller than 2^32).
+ * @param word_2 The index of the second word (smaller than 2^32).
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int shard_write_pair(shard_t *shard, float value, size_t word_1, size_t word_2);
+
+/**
+ * Flush the shard to the disk and give it its name, then deallocate it.
+ * @param shard The shard you are working with, created.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int shard_commit(shard_t *shard);
+
+/**
+ * Open the file of a shard, checking it was computed as info tells.
+ * @param dir The directory of the shard files.
+ * @param info What the shard must be computed from.
+ * @return Return a pointer to a newly allocated shard, NULL if an error
+ * occured.
+ */
+shard_t *shard_open(const char *dir, const shard_info_t *info);
+
+/**
+ * Read the counters of the next tile, before its pairs.
+ * @param shard The shard you are working with, opened.
+ * @param tile Receives the counters of the tile.
+ * @return 0 if no error occured, -1 otherwise (the end of the file too).
+ */
+int shard_read_tile(shard_t *shard, shard_tile_t *tile);
+
+/**
+ * Read a pair of the current tile.
+ * @param shard The shard you are working with, opened.
+ * @param value Receives the similarity of the pair.
+ * @param word_1 Receives the index of the first word.
+ * @param word_2 Receives the index of the second word.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int shard_read_pair(shard_t *shard, float *value, size_t *word_1, size_t *word_2);
+
+/**
+ * Close the shard and deallocate it; a created shard which is not committed
+ * is removed.
+ * @param shard The shard you are working with.
+ */
+void shard_close(shard_t *shard);
+
+#endif /* SHARD_H */
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simstore.h"
+
+/*
+ * Open addressing hash table with linear probing, keyed by the pair packed in
+ * 64 bits (smallest index in the high half). The table size is a power of two
+ * kept at most half full; keys and values live in separate arrays so a probe
+ * sequence only walks the keys.
+ */
+#define SIMSTORE_INITIAL_BITS 10
+#define SIMSTORE_EMPTY UINT64_MAX
+#define SIMSTORE_KEY(w1, w2) (((w1) < (w2)) ? ((((uint64_t) (w1)) << 32) | (w2)) : ((((uint64_t) (w2)) << 32) | (w1)))
+#define SIMSTORE_HASH(key, bits) ((size_t) (((key) * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - (bits))))
+
+struct simstore_t {
+    uint64_t *keys;
+    float *values;
+    float floor;
+    size_t count, bits;
+};
+
+static int simstore_alloc(simstore_t *store, size_t bits)
+{
+    size_t size = ((size_t) 1) << bits;
+
+    store->keys = malloc(size * sizeof(uint64_t));
+    store->values = malloc(size * sizeof(float));
+    if ((NULL == store->keys) || (NULL == store->values)) {
+        free(store->keys);
+        free(store->values);
+        return -1;
+    }
+    memset(store->keys, 0xff, size * sizeof(uint64_t));
+    store->bits = bits;
+
+    return 0;
+}
+
+static inline size_t simstore_slot(const simstore_t *store, uint64_t key)
+{
+    size_t mask = (((size_t) 1) << store->bits) - 1;
+    size_t slot = SIMSTORE_HASH(key, store->bits);
+
+    while ((SIMSTORE_EMPTY != store->keys[slot]) && (key != store->keys[slot]))
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+static int simstore_grow(simstore_t *store)
+{
+    uint64_t *keys = store->keys;
+    float *values = store->values;
+    size_t i, slot, size = ((size_t) 1) << store->bits;
+
+    if (0 != simstore_alloc(store, store->bits + 1)) {
+        store->keys = keys;
+        store->values = values;
+        return -1;
+    }
+    for (i = 0; i < size; i++) {
+        if (SIMSTORE_EMPTY != keys[i]) {
+            slot = simstore_slot(store, keys[i]);
+            store->keys[slot] = keys[i];
+            store->values[slot] = values[i];
+        }
+    }
+    free(keys);
+    free(values);
+
+    return 0;
+}
+
+simstore_t *simstore_make(float floor)
+{
+    simstore_t *store;
+
+    if (NULL == (store = malloc(sizeof(simstore_t))))
+        return NULL;
+    if (0 != simstore_alloc(store, SIMSTORE_INITIAL_BITS)) {
+        free(store);
+        return NULL;
+    }
+    store->floor = floor;
+    store->count = 0;
+
+    return store;
+}
+
+void simstore_destroy(simstore_t *store)
+{
+    if (NULL != store) {
+        free(store->keys);
+        free(store->values);
+        free(store);
+    }
+}
+
+int simstore_set(simstore_t *store, size_t word_1, size_t word_2, float value)
+{
+    uint64_t key;
+    size_t slot;
+
+    if (value < store->floor)
+        return 0;
+    if (2 * (store->count + 1) > (((size_t) 1) << store->bits)) {
+        if (0 != simstore_grow(store)) {
+            perror("simstore_grow");
+            return -1;
+        }
+    }
+
+    key = SIMSTORE_KEY(word_1, word_2);
+    slot = simstore_slot(store, key);
+    if (SIMSTORE_EMPTY == store->keys[slot]) {
+        store->keys[slot] = key;
+        store->count++;
+    }
+    store->values[slot] = value;
+
+    return 0;
+}
+
+float simstore_get(const simstore_t *store, size_t word_1, size_t word_2)
+{
+    size_t slot;
+
+    if (word_1 == word_2)
+        return 1.0;
+
+    slot = simstore_slot(store, SIMSTORE_KEY(word_1, word_2));
+
+    return (SIMSTORE_EMPTY == store->keys[slot]) ? SIMSTORE_BELOW : store->values[slot];
+}
+
+size_t simstore_size(const simstore_t *store)
+{
+    return store->count;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef SIMSTORE_H
+#define SIMSTORE_H
+
+#define SIMSTORE_BELOW (-1.0f)
+
+typedef struct simstore_t simstore_t;
+
+/**
+ * Make a new similarity store: a sparse symmetric matrix of the similarity of
+ * pairs of words, which only keeps the pairs at or above a floor, so its size
+ * follows the number of close pairs instead of the square of the number of
+ * words.
+ * @param floor The smallest similarity worth keeping.
+ * @return Return a pointer to a newly allocated store, NULL if an error
+ * occured.
+ */
+simstore_t *simstore_make(float floor);
+
+/**
+ * Deallocate the store.
+ * @param store The store you are working with.
+ */
+void simstore_destroy(simstore_t *store);
+
+/**
+ * Set the similarity of a pair of words (in any order, word indexes must be
+ * smaller than 2^32), ignored if it is below the floor.
+ * @param store The store you are working with.
+ * @param word_1 The index of the first word.
+ * @param word_2 The index of the second word.
+ * @param value The similarity.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int simstore_set(simstore_t *store, size_t word_1, size_t word_2, float value);
+
+/**
+ * Get the similarity of a pair of words.
+ * @param store The store you are working with.
+ * @param word_1 The index of the first word.
+ * @param word_2 The index of the second word.
+ * @return The similarity, 1.0 for a word and itself, SIMSTORE_BELOW if the
+ * pair is below the floor (or was never set).
+ */
+float simstore_get(const simstore_t *store, size_t word_1, size_t word_2);
+
+/**
+ * Get the number of pairs held.
+ * @param store The store you are working with.
+ * @return The number of pairs.
+ */
+size_t simstore_size(const simstore_t *store);
+
+#endif /* SIMSTORE_H */
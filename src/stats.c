@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+static const char *pass_names[STATS_PASSES] = { "first", "second", "third", "fourth" };
+
+static double seconds_since(const struct timespec *start, const struct timespec *now)
+{
+    return (double) (now->tv_sec - start->tv_sec) + (double) (now->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void stats_init(stats_t *stats)
+{
+    memset(stats, 0, sizeof(stats_t));
+    clock_gettime(CLOCK_MONOTONIC, &stats->wall_start);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stats->cpu_start);
+}
+
+double stats_pass_done(stats_t *stats)
+{
+    struct timespec wall, cpu;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    elapsed = seconds_since(&stats->wall_start, &wall);
+    if (stats->pass < STATS_PASSES) {
+        stats->wall[stats->pass] = elapsed;
+        stats->cpu[stats->pass] = seconds_since(&stats->cpu_start, &cpu);
+        stats->pass++;
+    }
+    stats->wall_start = wall;
+    stats->cpu_start = cpu;
+
+    return elapsed;
+}
+
+static size_t size_bucket(size_t size)
+{
+    size_t b;
+
+    for (b = 0; (b + 1 < STATS_SIZE_BUCKETS) && ((size >> (b + 1)) > 0); b++);
+
+    return b;
+}
+
+static void write_histogram(FILE *out, const size_t *buckets)
+{
+    size_t b;
+    int first;
+
+    fprintf(out, "{");
+    for (b = 0, first = 1; b < STATS_SIZE_BUCKETS; b++) {
+        if (0 != buckets[b]) {
+            fprintf(out, "%s\"%zu\": %zu", first ? "" : ", ", ((size_t) 1) << b, buckets[b]);
+            first = 0;
+        }
+    }
+    fprintf(out, "}");
+}
+
+void stats_cluster(stats_t *stats, size_t size)
+{
+    stats->sizes[size_bucket(size)]++;
+    stats->nb_clusters++;
+}
+
+void stats_rejection(stats_t *stats, size_t nb_cells)
+{
+    stats->nb_rejected++;
+    stats->cells_rejected += nb_cells;
+    if (nb_cells > stats->max_cells_rejected)
+        stats->max_cells_rejected = nb_cells;
+    stats->rejected_cells[size_bucket(nb_cells)]++;
+}
+
+int stats_write(stats_t *stats, const char *file)
+{
+    struct rusage rusage;
+    FILE *out;
+    size_t p;
+
+    if (0 == getrusage(RUSAGE_SELF, &rusage))
+        stats->peak_rss_kb = rusage.ru_maxrss;
+    if (NULL == (out = fopen(file, "w"))) {
+        perror(file);
+        return -1;
+    }
+    fprintf(out, "{\n  \"passes\": {");
+    for (p = 0; p < STATS_PASSES; p++)
+        fprintf(out, "%s\n    \"%s\": {\"wall_s\": %.6f, \"cpu_s\": %.6f}", (0 == p) ? "" : ",", pass_names[p], stats->wall[p],
+                stats->cpu[p]);
+    fprintf(out, "\n  },\n");
+    fprintf(out, "  \"peak_rss_kb\": %ld,\n", stats->peak_rss_kb);
+    fprintf(out, "  \"words\": {\"loaded\": %zu, \"skipped\": %zu, \"duplicates\": %zu, \"distinct\": %zu},\n", stats->nb_loaded,
+            stats->nb_skipped, stats->nb_duplicates, stats->nb_loaded - stats->nb_duplicates);
+    /* Every pair is pruned by its length, filtered by the index, or scored. */
+    fprintf(out, "  \"pairs\": {\"total\": %zu, \"scored\": %zu, \"pruned_by_length\": %zu, \"filtered_by_index\": %zu, "
+            "\"below_cutoff\": %zu, \"stored\": %zu, \"queue_max\": %zu, \"sorted_runs\": %zu},\n", stats->nb_pairs,
+            stats->nb_pairs - stats->nb_pruned - stats->nb_filtered, stats->nb_pruned, stats->nb_filtered, stats->nb_below,
+            stats->nb_stored, stats->queue_max, stats->nb_runs);
+    if (0 != stats->lsh_candidates)
+        fprintf(out, "  \"lsh\": {\"candidates\": %zu, \"oversized_buckets\": %zu, \"skipped_pairs\": %zu, \"sampled_similar\": %zu, "
+                "\"sampled_found\": %zu, \"recall\": %.6f},\n", stats->lsh_candidates, stats->lsh_oversized, stats->lsh_skipped,
+                stats->lsh_similar, stats->lsh_found,
+                (0 == stats->lsh_similar) ? 1.0 : (double) stats->lsh_found / (double) stats->lsh_similar);
+    fprintf(out, "  \"merges\": {\"accepted\": %zu, \"rejected\": %zu, \"rejected_from_cache\": %zu, \"cells_accepted\": %zu, "
+            "\"cells_rejected\": %zu, \"max_cells_rejected\": %zu, \"cells_per_rejection\": ", stats->nb_merged,
+            stats->nb_rejected, stats->nb_cached, stats->cells_merged, stats->cells_rejected, stats->max_cells_rejected);
+    write_histogram(out, stats->rejected_cells);
+    fprintf(out, "},\n  \"clusters\": %zu,\n  \"cluster_sizes\": ", stats->nb_clusters);
+    write_histogram(out, stats->sizes);
+    fprintf(out, "\n}\n");
+    if (0 != fclose(out)) {
+        perror(file);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <time.h>
+
+#define STATS_PASSES 4
+/* Cluster sizes (and cells of a rejection) are counted by powers of 2: bucket b holds [2^b, 2^(b+1)). */
+#define STATS_SIZE_BUCKETS 64
+
+/*
+ * Counters of a run. They are plain fields, updated by the caller once per
+ * pass or per merge check; the hot loops of the threads keep their own
+ * counters, added up here once joined.
+ */
+struct stats_t {
+    /* Start of the pass being timed. */
+    struct timespec wall_start, cpu_start;
+    size_t pass;
+    double wall[STATS_PASSES], cpu[STATS_PASSES];
+
+    /* First pass. */
+    size_t nb_loaded, nb_skipped, nb_duplicates;
+    /* Third pass. */
+    size_t nb_pairs, nb_pruned, nb_filtered, nb_below, nb_stored, queue_max, nb_runs;
+    /* Pairs sharing a MinHash band, those left out by the cap of the buckets, and the recall sample. */
+    size_t lsh_candidates, lsh_oversized, lsh_skipped, lsh_similar, lsh_found;
+    /* Fourth pass: merge checks, and the pairs of words they looked at. */
+    size_t nb_merged, nb_rejected, nb_cached;
+    size_t cells_merged, cells_rejected, max_cells_rejected, rejected_cells[STATS_SIZE_BUCKETS];
+    size_t nb_clusters, sizes[STATS_SIZE_BUCKETS];
+
+    long peak_rss_kb;
+};
+typedef struct stats_t stats_t;
+
+/**
+ * Reset the counters and start timing the first pass.
+ * @param stats The statistics you are working with.
+ */
+void stats_init(stats_t *stats);
+
+/**
+ * End the pass being timed (wall and CPU time of the process) and start the
+ * next one.
+ * @param stats The statistics you are working with.
+ * @return The wall time of the pass, in seconds.
+ */
+double stats_pass_done(stats_t *stats);
+
+/**
+ * Count a cluster in the histogram of cluster sizes.
+ * @param stats The statistics you are working with.
+ * @param size The number of words of the cluster.
+ */
+void stats_cluster(stats_t *stats, size_t size);
+
+/**
+ * Count a merge rejected after scanning pairs of words of the two clusters.
+ * @param stats The statistics you are working with.
+ * @param nb_cells The number of pairs of words scanned.
+ */
+void stats_rejection(stats_t *stats, size_t nb_cells);
+
+/**
+ * Record the peak RSS of the process, and write the statistics as a JSON
+ * object.
+ * @param stats The statistics you are working with.
+ * @param file The name of the file to write.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int stats_write(stats_t *stats, const char *file);
+
+#endif /* STATS_H */
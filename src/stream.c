@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "levenshtein.h"
+#include "stream.h"
+
+#define STREAM_NONE ((size_t) -1)
+/* Same folding as the distance kernels. */
+#define STREAM_FOLD(c) ((unsigned char) ((((unsigned char) (c)) >= 'A' && ((unsigned char) (c)) <= 'Z') ? ((c) | 0x20) : (c)))
+#define STREAM_GRAM(s) ((STREAM_FOLD((s)[0]) << 8) | STREAM_FOLD((s)[1]))
+#define STREAM_Q 2
+#define STREAM_GRAMS 65536
+#define STREAM_REJECTED LONG_MAX
+
+struct stream_cluster_t {
+    char *reps[STREAM_REPRESENTATIVES];
+    size_t lens[STREAM_REPRESENTATIVES];
+    size_t nb_reps;
+};
+
+/*
+ * A word joins a cluster only if it is similar enough to each representative,
+ * the first one in particular: clusters are only found through their first
+ * representative. Its bigrams (each one once) index the cluster, and the
+ * count filter (Ukkonen 1992: an edit touches at most q grams, so two words
+ * within k edits, the longest of length l, share at least l - q + 1 - k * q
+ * grams) leaves the clusters worth comparing to a word. For the lengths where
+ * the filter can't tell anything (short words, low similarity), the clusters
+ * whose first representative has that length are found in its bucket, which
+ * only keeps the STREAM_BUCKET_CLUSTERS of them which received a word last.
+ */
+struct stream_list_t {
+    size_t *clusters;
+    size_t nb_clusters, max_clusters;
+};
+
+struct stream_t {
+    float min_similarity;
+    struct stream_cluster_t *clusters;
+    size_t nb_clusters, max_clusters;
+    /* Clusters holding each gram, in creation order. */
+    struct stream_list_t *grams;
+    /* Per cluster: grams shared with the word being assigned, and those with some. */
+    size_t *counts, *touched;
+    /* Per length of the first representative: the bucket, and the grams needed for the word being assigned. */
+    struct stream_list_t *by_length;
+    long *min_common;
+    size_t nb_lengths;
+};
+
+stream_t *stream_make(float min_similarity)
+{
+    stream_t *stream;
+
+    if (NULL == (stream = calloc(1, sizeof(stream_t))))
+        return NULL;
+    stream->min_similarity = min_similarity;
+    if (NULL == (stream->grams = calloc(STREAM_GRAMS, sizeof(struct stream_list_t)))) {
+        free(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+void stream_destroy(stream_t *stream)
+{
+    size_t c, r;
+
+    if (NULL != stream) {
+        for (c = 0; c < stream->nb_clusters; c++) {
+            for (r = 0; r < stream->clusters[c].nb_reps; r++)
+                free(stream->clusters[c].reps[r]);
+        }
+        for (c = 0; c < stream->nb_lengths; c++)
+            free(stream->by_length[c].clusters);
+        for (c = 0; c < STREAM_GRAMS; c++)
+            free(stream->grams[c].clusters);
+        free(stream->clusters);
+        free(stream->counts);
+        free(stream->touched);
+        free(stream->grams);
+        free(stream->by_length);
+        free(stream->min_common);
+        free(stream);
+    }
+}
+
+static int stream_list_append(struct stream_list_t *list, size_t cluster)
+{
+    size_t new_max, *clusters;
+
+    if (list->nb_clusters == list->max_clusters) {
+        new_max = (0 == list->max_clusters) ? 4 : 2 * list->max_clusters;
+        if (NULL == (clusters = realloc(list->clusters, new_max * sizeof(size_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        list->clusters = clusters;
+        list->max_clusters = new_max;
+    }
+    list->clusters[list->nb_clusters++] = cluster;
+
+    return 0;
+}
+
+/* Move a cluster to the end of the bucket of its first representative, evicting the first one of a full bucket. */
+static int stream_touch(stream_t *stream, size_t cluster)
+{
+    struct stream_list_t *bucket, *by_length;
+    size_t len = stream->clusters[cluster].lens[0];
+    size_t new_max, k;
+    long *min_common;
+
+    if (len >= stream->nb_lengths) {
+        new_max = (0 == stream->nb_lengths) ? 64 : stream->nb_lengths;
+        while (new_max <= len)
+            new_max *= 2;
+        if (NULL == (by_length = realloc(stream->by_length, new_max * sizeof(struct stream_list_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        memset(by_length + stream->nb_lengths, 0, (new_max - stream->nb_lengths) * sizeof(struct stream_list_t));
+        stream->by_length = by_length;
+        if (NULL == (min_common = realloc(stream->min_common, new_max * sizeof(long)))) {
+            perror("realloc");
+            return -1;
+        }
+        stream->min_common = min_common;
+        stream->nb_lengths = new_max;
+    }
+    bucket = stream->by_length + len;
+    for (k = 0; (k < bucket->nb_clusters) && (cluster != bucket->clusters[k]); k++);
+    if (k == bucket->nb_clusters) {
+        if (bucket->nb_clusters < STREAM_BUCKET_CLUSTERS)
+            return stream_list_append(bucket, cluster);
+        k = 0;
+    }
+    memmove(bucket->clusters + k, bucket->clusters + k + 1, (bucket->nb_clusters - k - 1) * sizeof(size_t));
+    bucket->clusters[bucket->nb_clusters - 1] = cluster;
+
+    return 0;
+}
+
+static int stream_represent(stream_t *stream, size_t cluster, const char *word, size_t len)
+{
+    struct stream_cluster_t *c = stream->clusters + cluster;
+
+    if (NULL == (c->reps[c->nb_reps] = strndup(word, len))) {
+        perror("strndup");
+        return -1;
+    }
+    c->lens[c->nb_reps++] = len;
+
+    return 0;
+}
+
+/* Smallest similarity of a word to the representatives of a cluster, if not below floor. */
+static float stream_linkage(const struct stream_cluster_t *cluster, const char *word, size_t len, float floor)
+{
+    size_t r;
+    float value, linkage = 1.0;
+
+    for (r = 0; r < cluster->nb_reps; r++) {
+        if (len <= cluster->lens[r])
+            value = levenshtein_norm_distance_bounded(word, len, cluster->reps[r], cluster->lens[r], floor);
+        else
+            value = levenshtein_norm_distance_bounded(cluster->reps[r], cluster->lens[r], word, len, floor);
+        if (LEVENSHTEIN_BELOW == value)
+            return LEVENSHTEIN_BELOW;
+        if (value < linkage)
+            linkage = value;
+    }
+
+    return linkage;
+}
+
+/* Keep the cluster if the word is closer to it than to best (or as close, and it is older). */
+static void stream_consider(const stream_t *stream, size_t c, const char *word, size_t len, size_t *best, float *best_linkage)
+{
+    float linkage = stream_linkage(stream->clusters + c, word, len, *best_linkage);
+
+    if ((LEVENSHTEIN_BELOW != linkage) && ((STREAM_NONE == *best) || (linkage > *best_linkage) || ((linkage == *best_linkage) && (c < *best)))) {
+        *best = c;
+        *best_linkage = linkage;
+    }
+}
+
+/* A new cluster, the word its first representative. */
+static int stream_create(stream_t *stream, const char *word, size_t len, size_t *cluster)
+{
+    struct stream_cluster_t *clusters;
+    struct stream_list_t *list;
+    size_t new_max, *counts, *touched, i;
+
+    if (stream->nb_clusters == stream->max_clusters) {
+        new_max = (0 == stream->max_clusters) ? 64 : 2 * stream->max_clusters;
+        if (NULL == (clusters = realloc(stream->clusters, new_max * sizeof(struct stream_cluster_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        stream->clusters = clusters;
+        if (NULL == (counts = realloc(stream->counts, new_max * sizeof(size_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        memset(counts + stream->max_clusters, 0, (new_max - stream->max_clusters) * sizeof(size_t));
+        stream->counts = counts;
+        if (NULL == (touched = realloc(stream->touched, new_max * sizeof(size_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        stream->touched = touched;
+        stream->max_clusters = new_max;
+    }
+    memset(stream->clusters + stream->nb_clusters, 0, sizeof(struct stream_cluster_t));
+    *cluster = stream->nb_clusters++;
+    if (0 != stream_represent(stream, *cluster, word, len))
+        return -1;
+    for (i = 0; i + STREAM_Q <= len; i++) {
+        list = stream->grams + STREAM_GRAM(word + i);
+        /* A gram repeated in the word is only listed once. */
+        if ((0 != list->nb_clusters) && (*cluster == list->clusters[list->nb_clusters - 1]))
+            continue;
+        if (0 != stream_list_append(list, *cluster))
+            return -1;
+    }
+
+    return stream_touch(stream, *cluster);
+}
+
+int stream_assign(stream_t *stream, const char *word, size_t len, size_t *cluster)
+{
+    const struct stream_list_t *list, *bucket;
+    size_t l, lo, hi, longest, k, i, c, nb_touched, best = STREAM_NONE;
+    float best_linkage = stream->min_similarity;
+
+    /* A pair of words is at most as similar as the ratio of their lengths. */
+    lo = (size_t) ((float) len * stream->min_similarity);
+    hi = (stream->min_similarity > 0.0) ? (size_t) ((float) len / stream->min_similarity) + 1 : stream->nb_lengths;
+    if (hi >= stream->nb_lengths)
+        hi = (0 == stream->nb_lengths) ? 0 : stream->nb_lengths - 1;
+    if (0 == stream->nb_lengths)
+        return stream_create(stream, word, len, cluster);
+
+    /* Edits allowed and grams needed for each length of a first representative. */
+    for (l = lo; l <= hi; l++) {
+        k = levenshtein_max_edits(len, l, stream->min_similarity);
+        longest = (len > l) ? len : l;
+        if (k < longest - ((len < l) ? len : l))
+            stream->min_common[l] = STREAM_REJECTED;
+        else
+            stream->min_common[l] = (long) longest - STREAM_Q + 1 - (long) (k * STREAM_Q);
+    }
+
+    for (i = 0, nb_touched = 0; i + STREAM_Q <= len; i++) {
+        list = stream->grams + STREAM_GRAM(word + i);
+        for (k = 0; k < list->nb_clusters; k++) {
+            c = list->clusters[k];
+            l = stream->clusters[c].lens[0];
+            if ((l < lo) || (l > hi) || (stream->min_common[l] <= 0) || (STREAM_REJECTED == stream->min_common[l]))
+                continue;
+            if (0 == stream->counts[c]++)
+                stream->touched[nb_touched++] = c;
+        }
+    }
+    for (k = 0; k < nb_touched; k++) {
+        c = stream->touched[k];
+        if ((long) stream->counts[c] >= stream->min_common[stream->clusters[c].lens[0]])
+            stream_consider(stream, c, word, len, &best, &best_linkage);
+        stream->counts[c] = 0;
+    }
+    /* Lengths the filter can't tell anything about: the clusters which received a word last. */
+    for (l = lo; l <= hi; l++) {
+        if (stream->min_common[l] > 0)
+            continue;
+        for (bucket = stream->by_length + l, k = 0; k < bucket->nb_clusters; k++)
+            stream_consider(stream, bucket->clusters[k], word, len, &best, &best_linkage);
+    }
+
+    if (STREAM_NONE == best)
+        return stream_create(stream, word, len, cluster);
+    *cluster = best;
+    if ((stream->clusters[best].nb_reps < STREAM_REPRESENTATIVES) && (0 != stream_represent(stream, best, word, len)))
+        return -1;
+
+    return stream_touch(stream, best);
+}
+
+size_t stream_nb_clusters(const stream_t *stream)
+{
+    return stream->nb_clusters;
+}
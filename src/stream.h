@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+/* Words kept to stand for a cluster, the first ones it received. */
+#define STREAM_REPRESENTATIVES 8
+/* Clusters compared per length when the bigrams can't tell, those which received a word last. */
+#define STREAM_BUCKET_CLUSTERS 1024
+
+typedef struct stream_t stream_t;
+
+/**
+ * Make a new online clustering: words come one at a time and each goes at
+ * once to the cluster whose representatives it is all similar enough to
+ * (complete linkage against the representatives only), or starts a cluster
+ * of its own. A word is only compared, with the bounded distance, to the
+ * clusters whose first representative has a compatible length and shares
+ * enough bigrams with it to reach min_similarity. Where sharing no bigram is
+ * not enough to rule a cluster out, only the STREAM_BUCKET_CLUSTERS of that
+ * length which received a word last are compared.
+ * @param min_similarity The similarity a word must reach with every
+ * representative of a cluster to join it.
+ * @return Return a pointer to a newly allocated clustering, NULL if an error
+ * occured.
+ */
+stream_t *stream_make(float min_similarity);
+
+/**
+ * Deallocate the clustering.
+ * @param stream The clustering you are working with.
+ */
+void stream_destroy(stream_t *stream);
+
+/**
+ * Assign a word to a cluster: the one where its smallest similarity to the
+ * representatives is the highest (the oldest one on a tie), a new one if
+ * none reaches min_similarity.
+ * @param stream The clustering you are working with.
+ * @param word The word, copied if it becomes a representative.
+ * @param len The length of the word.
+ * @param cluster Receives the number of the cluster, clusters being numbered
+ * from 0 in order of creation.
+ * @return 0 if no error occured, -1 otherwise.
+ */
+int stream_assign(stream_t *stream, const char *word, size_t len, size_t *cluster);
+
+/**
+ * Get the number of clusters.
+ * @param stream The clustering you are working with.
+ * @return The number of clusters.
+ */
+size_t stream_nb_clusters(const stream_t *stream);
+
+#endif /* STREAM_H */
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdlib.h>
+
+#include "union_find.h"
+
+struct union_find_t {
+    size_t *parent;
+    /* Number of elements, meaningful on roots only. */
+    size_t *size;
+};
+
+union_find_t *union_find_make(size_t nb_elements)
+{
+    union_find_t *sets;
+    size_t i;
+
+    if (NULL == (sets = malloc(sizeof(union_find_t))))
+        return NULL;
+    sets->parent = malloc((nb_elements + 1) * sizeof(size_t));
+    sets->size = malloc((nb_elements + 1) * sizeof(size_t));
+    if ((NULL == sets->parent) || (NULL == sets->size)) {
+        union_find_destroy(sets);
+        return NULL;
+    }
+    for (i = 0; i < nb_elements; i++) {
+        sets->parent[i] = i;
+        sets->size[i] = 1;
+    }
+
+    return sets;
+}
+
+void union_find_destroy(union_find_t *sets)
+{
+    if (NULL != sets) {
+        free(sets->parent);
+        free(sets->size);
+        free(sets);
+    }
+}
+
+size_t union_find_find(union_find_t *sets, size_t element)
+{
+    /* Path halving: every other node on the way points to its grandparent. */
+    while (sets->parent[element] != element) {
+        sets->parent[element] = sets->parent[sets->parent[element]];
+        element = sets->parent[element];
+    }
+
+    return element;
+}
+
+size_t union_find_union(union_find_t *sets, size_t element_1, size_t element_2)
+{
+    size_t root_1 = union_find_find(sets, element_1);
+    size_t root_2 = union_find_find(sets, element_2);
+
+    if (root_1 == root_2)
+        return root_1;
+    if (sets->size[root_1] < sets->size[root_2]) {
+        sets->parent[root_1] = root_2;
+        sets->size[root_2] += sets->size[root_1];
+        return root_2;
+    }
+    sets->parent[root_2] = root_1;
+    sets->size[root_1] += sets->size[root_2];
+
+    return root_1;
+}
+
+size_t union_find_size(union_find_t *sets, size_t element)
+{
+    return sets->size[union_find_find(sets, element)];
+}
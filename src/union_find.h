@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef UNION_FIND_H
+#define UNION_FIND_H
+
+typedef struct union_find_t union_find_t;
+
+/**
+ * Make a new disjoint-set forest over elements 0 to nb_elements - 1, each in
+ * a set of its own. Finding the set of an element and merging two sets cost
+ * an almost constant amortized time (path halving, union by size).
+ * @param nb_elements The number of elements.
+ * @return Return a pointer to a newly allocated forest, NULL if an error
+ * occured.
+ */
+union_find_t *union_find_make(size_t nb_elements);
+
+/**
+ * Deallocate the forest.
+ * @param sets The forest you are working with.
+ */
+void union_find_destroy(union_find_t *sets);
+
+/**
+ * Find the representative (root) of the set of an element.
+ * @param sets The forest you are working with.
+ * @param element The element.
+ * @return The root of the set holding element.
+ */
+size_t union_find_find(union_find_t *sets, size_t element);
+
+/**
+ * Merge the sets of two elements.
+ * @param sets The forest you are working with.
+ * @param element_1 An element of the first set.
+ * @param element_2 An element of the second set.
+ * @return The root of the merged set, the root of the largest of the two.
+ */
+size_t union_find_union(union_find_t *sets, size_t element_1, size_t element_2);
+
+/**
+ * Get the number of elements of the set of an element.
+ * @param sets The forest you are working with.
+ * @param element The element.
+ * @return The size of the set.
+ */
+size_t union_find_size(union_find_t *sets, size_t element);
+
+#endif /* UNION_FIND_H */
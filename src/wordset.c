@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wordset.h"
+
+/* Same folding as the distance kernels. */
+#define WORDSET_FOLD(c) ((unsigned char) ((((unsigned char) (c)) >= 'A' && ((unsigned char) (c)) <= 'Z') ? ((c) | 0x20) : (c)))
+
+#define WORDSET_ONES 0x0101010101010101ULL
+#define WORDSET_HIGHS 0x8080808080808080ULL
+#define WORDSET_MUL 0x9e3779b97f4a7c15ULL
+
+struct wordset_slot_t {
+    const char *word;
+    size_t len;
+    size_t value;
+    uint64_t hash;
+};
+
+struct wordset_t {
+    struct wordset_slot_t *slots;
+    /* The table has 2^bits slots, at most half of them used. */
+    size_t bits, count;
+};
+
+/*
+ * Folds 8 characters at once: a byte gets 0x20 when its low 7 bits are in
+ * 'A'..'Z' and its high bit is clear, computed on the high bit of each byte
+ * (no carry crosses a byte).
+ */
+static inline uint64_t wordset_fold8(uint64_t x)
+{
+    uint64_t low = x & ~WORDSET_HIGHS;
+    uint64_t ge_a = low + (0x80 - 'A') * WORDSET_ONES;
+    uint64_t gt_z = low + (0x80 - 'Z' - 1) * WORDSET_ONES;
+
+    return x | (((ge_a & ~gt_z & ~x) & WORDSET_HIGHS) >> 2);
+}
+
+/* Multiply and rotate over 8 folded characters at a time. */
+static uint64_t wordset_hash(const char *word, size_t len)
+{
+    uint64_t h = len * WORDSET_MUL, chunk;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&chunk, word + i, 8);
+        h = (h ^ wordset_fold8(chunk)) * WORDSET_MUL;
+        h ^= h >> 29;
+    }
+    if (i < len) {
+        chunk = 0;
+        memcpy(&chunk, word + i, len - i);
+        h = (h ^ wordset_fold8(chunk)) * WORDSET_MUL;
+        h ^= h >> 29;
+    }
+    h ^= h >> 32;
+
+    return (0 == h) ? 1 : h;
+}
+
+static int wordset_equal(const char *w1, const char *w2, size_t len)
+{
+    size_t i;
+
+    for (i = 0; (i < len) && (WORDSET_FOLD(w1[i]) == WORDSET_FOLD(w2[i])); i++);
+
+    return i == len;
+}
+
+static int wordset_alloc(wordset_t *set, size_t bits)
+{
+    set->slots = calloc(((size_t) 1) << bits, sizeof(struct wordset_slot_t));
+    if (NULL == set->slots)
+        return -1;
+    set->bits = bits;
+
+    return 0;
+}
+
+/* Slot of hash, the empty one ending its probe sequence if the word is not there. */
+static size_t wordset_slot(const wordset_t *set, uint64_t hash, const char *word, size_t len)
+{
+    size_t mask = (((size_t) 1) << set->bits) - 1;
+    size_t slot = (size_t) (hash * WORDSET_MUL >> (64 - set->bits)) & mask;
+
+    while ((0 != set->slots[slot].hash)
+           && ((set->slots[slot].hash != hash) || (set->slots[slot].len != len) || !wordset_equal(set->slots[slot].word, word, len)))
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+static int wordset_grow(wordset_t *set)
+{
+    struct wordset_slot_t *old = set->slots;
+    size_t i, nb_old = ((size_t) 1) << set->bits;
+
+    if (0 != wordset_alloc(set, set->bits + 1)) {
+        set->slots = old;
+        return -1;
+    }
+    for (i = 0; i < nb_old; i++) {
+        if (0 != old[i].hash)
+            set->slots[wordset_slot(set, old[i].hash, old[i].word, old[i].len)] = old[i];
+    }
+    free(old);
+
+    return 0;
+}
+
+wordset_t *wordset_make(size_t expected)
+{
+    wordset_t *set;
+    size_t bits;
+
+    if (NULL == (set = calloc(1, sizeof(wordset_t))))
+        return NULL;
+    for (bits = 4; (((size_t) 1) << bits) < 2 * expected; bits++);
+    if (0 != wordset_alloc(set, bits)) {
+        free(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+void wordset_destroy(wordset_t *set)
+{
+    if (NULL != set) {
+        free(set->slots);
+        free(set);
+    }
+}
+
+int wordset_add(wordset_t *set, const char *word, size_t len, size_t value, size_t *found)
+{
+    uint64_t hash = wordset_hash(word, len);
+    size_t slot;
+
+    slot = wordset_slot(set, hash, word, len);
+    if (0 != set->slots[slot].hash) {
+        *found = set->slots[slot].value;
+        return 0;
+    }
+    if (2 * (set->count + 1) > (((size_t) 1) << set->bits)) {
+        if (0 != wordset_grow(set)) {
+            perror("wordset_grow");
+            return -1;
+        }
+        slot = wordset_slot(set, hash, word, len);
+    }
+    set->slots[slot].word = word;
+    set->slots[slot].len = len;
+    set->slots[slot].value = value;
+    set->slots[slot].hash = hash;
+    set->count++;
+
+    return 1;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2014  François Pesce
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 2; tab-width: 0 -*- */
+
+#ifndef WORDSET_H
+#define WORDSET_H
+
+typedef struct wordset_t wordset_t;
+
+/**
+ * Make a new set of words, compared case insensitively (the folding of the
+ * distance kernels), each one with a value: an open addressing hash table
+ * which does not copy the words.
+ * @param expected The number of words expected, to size the table.
+ * @return Return a pointer to a newly allocated set, NULL if an error
+ * occured.
+ */
+wordset_t *wordset_make(size_t expected);
+
+/**
+ * Deallocate the set.
+ * @param set The set you are working with.
+ */
+void wordset_destroy(wordset_t *set);
+
+/**
+ * Add a word to the set, unless it holds it already.
+ * @param set The set you are working with.
+ * @param word The word, which must outlive the set.
+ * @param len The length of the word.
+ * @param value The value of the word, if it is added.
+ * @param found Receives the value of the word held, if it is not added.
+ * @return 1 if the word was added, 0 if the set held it, -1 if an error
+ * occured.
+ */
+int wordset_add(wordset_t *set, const char *word, size_t len, size_t value, size_t *found);
+
+#endif /* WORDSET_H */